@@ -0,0 +1,15 @@
+#!/usr/bin/python3
+# Sends the request body back while it's still reading it
+import os
+import sys
+
+length = int(os.environ.get("CONTENT_LENGTH", "0"))
+sys.stdout.write("Content-Type: application/octet-stream\r\n\r\n")
+sys.stdout.flush()
+while length > 0:
+    data = os.read(0, min(length, 65536))
+    if not data:
+        break
+    length -= len(data)
+    sys.stdout.buffer.write(data)
+    sys.stdout.flush()
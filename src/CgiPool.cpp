@@ -0,0 +1,230 @@
+#include "CgiPool.hpp"
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include "Logger/Logger.hpp"
+#include "PidTracker.hpp"
+#include "exceptions/RequestError.hpp"
+#include "utils/Spawn.hpp"
+#include "utils/Utils.hpp"
+
+PoolWorker::PoolWorker()
+    : address(),
+      outstanding(0),
+      served(0),
+      stuck(false),
+      idle_since(Utils::getCurrentTime())
+{}
+
+CgiPool::CgiPool(const std::string& bin_path, const CgiPoolSettings& settings)
+    : bin_path_(bin_path), settings_(settings)
+{}
+
+/*
+ * Same as in the PidTracker, there's no time left to let them finish
+ */
+CgiPool::~CgiPool()
+{
+  for (MPoolWorkers::iterator it = workers_.begin(); it != workers_.end();
+       ++it)
+  {
+    kill(it->first, SIGKILL);
+    waitpid(it->first, NULL, 0);
+  }
+}
+
+bool CgiPool::enabled() const
+{
+  return settings_.max > 0;
+}
+
+/*
+ * Picks the worker for the next request and returns the address to connect
+ * to. `worker` has to be released once the request is done.
+ */
+const FastCgiAddress& CgiPool::acquire(pid_t& worker)
+{
+  MPoolWorkers::iterator best = workers_.end();
+  size_t serving = 0;
+
+  for (MPoolWorkers::iterator it = workers_.begin(); it != workers_.end();
+       ++it)
+  {
+    if (retiring(it->second))
+      continue;
+    ++serving;
+    if (best == workers_.end() ||
+        it->second.outstanding < best->second.outstanding)
+      best = it;
+  }
+  if ((best == workers_.end() || best->second.outstanding > 0) &&
+      serving < settings_.max)
+    best = spawn();
+
+  ++best->second.outstanding;
+  ++best->second.served;
+  worker = best->first;
+  return best->second.address;
+}
+
+/*
+ * The worker may have died and been removed in the meantime
+ */
+void CgiPool::release(pid_t worker, bool finished)
+{
+  MPoolWorkers::iterator it = workers_.find(worker);
+  if (it == workers_.end())
+    return;
+  if (!finished)
+    it->second.stuck = true;
+  if (--it->second.outstanding > 0)
+    return;
+
+  it->second.idle_since = Utils::getCurrentTime();
+  if (retiring(it->second))
+    retire(it);
+}
+
+/*
+ * Called once per loop iteration: removes workers that exited, stops the
+ * ones idle for too long and starts new ones until there are `min`.
+ *
+ * Returns true while there are workers that might still become idle for too
+ * long, so the caller doesn't sleep in epoll_wait without a timeout.
+ */
+bool CgiPool::maintain(u_int64_t current_time)
+{
+  if (!enabled())
+    return false;
+
+  size_t serving = 0;
+  MPoolWorkers::iterator it = workers_.begin();
+  while (it != workers_.end())
+  {
+    if (waitpid(it->first, NULL, WNOHANG) != 0)
+    {
+      workers_.erase(it++);
+      continue;
+    }
+    if (!retiring(it->second))
+      ++serving;
+    ++it;
+  }
+
+  it = workers_.begin();
+  while (it != workers_.end() && serving > settings_.min)
+  {
+    const PoolWorker& worker = it->second;
+    if (worker.outstanding == 0 && !retiring(worker) &&
+        worker.idle_since + settings_.idle_timeout <= current_time)
+    {
+      retire(it++);
+      --serving;
+    }
+    else
+      ++it;
+  }
+
+  try
+  {
+    for (; serving < settings_.min; ++serving)
+      spawn();
+  }
+  catch (RequestError& e)
+  {
+    std::cerr << e.what() << std::endl;
+  }
+  return serving > settings_.min;
+}
+
+/*
+ * The socket is bound in the abstract namespace (leading NUL in the path),
+ * so nothing is left behind in the file system. The worker gets it as stdin
+ * and is told not to fork children of its own: the pool does that.
+ */
+MPoolWorkers::iterator CgiPool::spawn(void)
+{
+  static size_t spawned = 0;
+
+  std::ostringstream name;
+  name << "webserv-cgi." << getpid() << "." << spawned++;
+  PoolWorker worker;
+  struct sockaddr_un* address =
+      reinterpret_cast< struct sockaddr_un* >(&worker.address.address);
+  address->sun_family = AF_UNIX;
+  std::memcpy(address->sun_path + 1, name.str().data(), name.str().size());
+  worker.address.length = static_cast< socklen_t >(
+      offsetof(struct sockaddr_un, sun_path) + 1 + name.str().size());
+  worker.address.name = "@" + name.str();
+  worker.address.keep_conn = false;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1 ||
+      bind(fd, reinterpret_cast< struct sockaddr* >(address),
+           worker.address.length) == -1 ||
+      listen(fd, SOMAXCONN) == -1)
+  {
+    Utils::ft_close(fd);
+    throw RequestError(502, "Unable to create socket for CGI worker");
+  }
+
+  std::ostringstream max_requests;
+  max_requests << "PHP_FCGI_MAX_REQUESTS=" << settings_.max_requests;
+  std::string variables[] = {"PATH=/usr/bin/:/bin", "PHP_FCGI_CHILDREN=0",
+                             max_requests.str()};
+  char* envp[] = {const_cast< char* >(variables[0].c_str()),
+                  const_cast< char* >(variables[1].c_str()),
+                  const_cast< char* >(variables[2].c_str()), NULL};
+  char* argv[] = {const_cast< char* >(bin_path_.c_str()), NULL};
+
+  Utils::Spawn spawn;
+  spawn.dup2(fd, STDIN_FILENO);
+  spawn.open(STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+  Logger::setupChildStderr(spawn);
+  pid_t pid = spawn.run(bin_path_, argv, envp);
+  Utils::ft_close(fd);
+  if (pid == -1)
+    throw RequestError(502, "Unable to start CGI worker");
+  return workers_.insert(std::make_pair(pid, worker)).first;
+}
+
+bool CgiPool::retiring(const PoolWorker& worker) const
+{
+  return worker.stuck || (settings_.max_requests > 0 &&
+                          worker.served >= settings_.max_requests);
+}
+
+void CgiPool::retire(MPoolWorkers::iterator it)
+{
+  getPidTracker().killPid(it->first);
+  workers_.erase(it);
+}
+
+CgiPool& getPhpPool(void)
+{
+  Configuration& config = Configuration::getInstance();
+  const CgiPoolSettings& settings = config.getPhpPool();
+  static CgiPool pool(
+      settings.bin_path.empty() ? config.getPhpPath() : settings.bin_path,
+      settings);
+
+  return pool;
+}
+
+/*
+ * There's no default for .py, the parser insists on `bin=`
+ */
+CgiPool& getPythonPool(void)
+{
+  Configuration& config = Configuration::getInstance();
+  static CgiPool pool(config.getPythonPool().bin_path, config.getPythonPool());
+
+  return pool;
+}
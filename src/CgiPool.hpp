@@ -0,0 +1,64 @@
+#pragma once
+
+#include <sys/types.h>
+#include <map>
+#include <string>
+#include "Configs/Configs.hpp"
+
+/*
+ * One persistent interpreter of a pool. It's started like a FastCGI
+ * application gets started by its web server: with a listening socket of its
+ * own as stdin, on which it accepts one connection per request.
+ */
+struct PoolWorker
+{
+  PoolWorker();
+
+  FastCgiAddress address;  // Abstract unix socket the worker accepts on
+  size_t outstanding;      // Requests handed to it that haven't ended yet
+  size_t served;           // Requests handed to it in total
+  bool stuck;              // It didn't finish a request, it gets stopped
+  u_int64_t idle_since;
+};
+
+typedef std::map< pid_t, PoolWorker > MPoolWorkers;
+
+/*
+ * Preforked interpreters for a `cgi_path` (`cgi_pool`), reused across
+ * requests instead of forking one per request. The requests are passed to
+ * them with the FastCGI protocol, so the interpreter has to speak it on the
+ * socket it gets as stdin. php-cgi does, python3 doesn't: a .py pool needs a
+ * FastCGI server of its own (`bin=`).
+ *
+ * A request goes to an idle worker, or a new one as long as less than `max`
+ * take requests. Otherwise it's queued in the listen backlog of the worker
+ * with the fewest requests, so a spike doesn't start more processes. Workers
+ * that served `max_requests` or got stuck with a request only finish what
+ * they have before they're stopped.
+ */
+class CgiPool
+{
+ public:
+  CgiPool(const std::string& bin_path, const CgiPoolSettings& settings);
+  ~CgiPool();
+
+  bool enabled() const;
+  const FastCgiAddress& acquire(pid_t& worker);
+  void release(pid_t worker, bool finished);
+  bool maintain(u_int64_t current_time);
+
+ private:
+  std::string bin_path_;
+  CgiPoolSettings settings_;
+  MPoolWorkers workers_;
+
+  MPoolWorkers::iterator spawn(void);
+  bool retiring(const PoolWorker& worker) const;
+  void retire(MPoolWorkers::iterator it);
+
+  CgiPool(const CgiPool& other);
+  CgiPool& operator=(const CgiPool& other);
+};
+
+CgiPool& getPhpPool();
+CgiPool& getPythonPool();
@@ -1,10 +1,14 @@
 #include "Configs.hpp"
+#include <netdb.h>
 #include <sys/types.h>
 
 #include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 #include <cerrno>
 #include <cstddef>
 #include <cstdlib>
+#include <algorithm>
 #include <cstring>
 #include <exception>
 #include <fstream>
@@ -29,6 +33,8 @@ Configuration::Configuration()
 {
   cgi_timeout_ = std::make_pair(CGI_TIMEOUT_MAX, false);
   keep_alive_timeout_ = std::make_pair(KEEP_ALIVE_TIMEOUT_MAX, false);
+  sendfile_ = std::make_pair(true, false);
+  worker_processes_ = std::make_pair(1, false);
 }
 
 Configuration::~Configuration()
@@ -195,6 +201,213 @@ void Configuration::parseConfigFile(const string& config_file)
           throw Fatal("Invalid config file format: access_log requires exactly "
                       "1 argument");
       }
+      else if (identifier_token == "sendfile")
+      {
+        if (sendfile_.second)
+          throw Fatal("Invalid config file format: sendfile already defined");
+        std::string token;
+        if (!(ss >> token))
+          throw Fatal("Invalid config file format: expected sendfile value");
+        if (token == "on")
+          sendfile_.first = true;
+        else if (token == "off")
+          sendfile_.first = false;
+        else
+          throw Fatal("Invalid config file format: invalid sendfile value => " +
+                      token);
+        sendfile_.second = true;
+        if (ss >> token)
+          throw Fatal("Invalid config file format: sendfile requires exactly 1 "
+                      "argument");
+      }
+      else if (identifier_token == "worker_processes")
+      {
+        if (worker_processes_.second)
+          throw Fatal(
+              "Invalid config file format: worker_processes already defined");
+        std::string token;
+        if (!(ss >> token))
+          throw Fatal(
+              "Invalid config file format: expected worker_processes value");
+        if (token == "auto")
+        {
+          long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+          if (cpus < 1)
+            cpus = 1;
+          else if (cpus > WORKER_PROCESSES_MAX)
+            cpus = WORKER_PROCESSES_MAX;
+          worker_processes_.first = cpus;
+        }
+        else
+        {
+          try
+          {
+            worker_processes_.first =
+                Utils::ipStrToUint32Max(token, WORKER_PROCESSES_MAX);
+          }
+          catch (const Fatal& e)
+          {
+            worker_processes_.first = 0;
+          }
+          if (worker_processes_.first == 0)
+            throw Fatal("Invalid config file format: invalid worker_processes "
+                        "value => " +
+                        token);
+        }
+        worker_processes_.second = true;
+        if (ss >> token)
+          throw Fatal("Invalid config file format: worker_processes requires "
+                      "exactly 1 argument");
+      }
+      else if (identifier_token == "open_file_cache")
+      {
+        if (open_file_cache_.configured)
+          throw Fatal(
+              "Invalid config file format: open_file_cache already defined");
+        std::string token;
+        if (!(ss >> token))
+          throw Fatal(
+              "Invalid config file format: expected open_file_cache value");
+        open_file_cache_.configured = true;
+        if (token == "off")
+        {
+          if (ss >> token)
+            throw Fatal("Invalid config file format: open_file_cache off "
+                        "takes no further arguments");
+        }
+        else
+        {
+          bool max_set = false;
+          do
+          {
+            try
+            {
+              if (token.compare(0, 4, "max=") == 0 && !max_set)
+              {
+                open_file_cache_.max = Utils::ipStrToUint32Max(
+                    token.substr(4), OPEN_FILE_CACHE_MAX);
+                max_set = true;
+              }
+              else if (token.compare(0, 6, "valid=") == 0)
+                open_file_cache_.valid = Utils::ipStrToUint32Max(
+                    token.substr(6), OPEN_FILE_CACHE_VALID_MAX);
+              else
+                throw Fatal("Unknown argument");
+            }
+            catch (const Fatal& e)
+            {
+              throw Fatal("Invalid config file format: invalid "
+                          "open_file_cache argument => " +
+                          token);
+            }
+          } while (ss >> token);
+          if (!max_set || open_file_cache_.max == 0)
+            throw Fatal("Invalid config file format: open_file_cache requires "
+                        "max=N with N > 0");
+        }
+      }
+      else if (identifier_token == "file_cache")
+      {
+        if (file_cache_.configured)
+          throw Fatal("Invalid config file format: file_cache already defined");
+        std::string token;
+        if (!(ss >> token))
+          throw Fatal("Invalid config file format: expected file_cache value");
+        file_cache_.configured = true;
+        if (token == "off")
+        {
+          if (ss >> token)
+            throw Fatal("Invalid config file format: file_cache off takes no "
+                        "further arguments");
+        }
+        else
+        {
+          bool max_size_set = false;
+          do
+          {
+            try
+            {
+              if (token.compare(0, 9, "max_size=") == 0 && !max_size_set)
+              {
+                file_cache_.max_size =
+                    Utils::strToSize(token.substr(9), FILE_CACHE_MAX_SIZE);
+                max_size_set = true;
+              }
+              else if (token.compare(0, 9, "max_file=") == 0)
+                file_cache_.max_file =
+                    Utils::strToSize(token.substr(9), FILE_CACHE_MAX_SIZE);
+              else
+                throw Fatal("Unknown argument");
+            }
+            catch (const Fatal& e)
+            {
+              throw Fatal(
+                  "Invalid config file format: invalid file_cache argument "
+                  "=> " +
+                  token);
+            }
+          } while (ss >> token);
+          if (!max_size_set || file_cache_.max_size == 0)
+            throw Fatal("Invalid config file format: file_cache requires "
+                        "max_size=N with N > 0");
+        }
+      }
+      else if (identifier_token == "gzip")
+      {
+        if (gzip_.configured)
+          throw Fatal("Invalid config file format: gzip already defined");
+        std::string token;
+        if (!(ss >> token))
+          throw Fatal("Invalid config file format: expected gzip value");
+        gzip_.configured = true;
+        if (token == "off")
+        {
+          if (ss >> token)
+            throw Fatal("Invalid config file format: gzip off takes no "
+                        "further arguments");
+        }
+        else if (token == "on")
+        {
+          gzip_.enabled = true;
+          while (ss >> token)
+          {
+            try
+            {
+              if (token.compare(0, 11, "min_length=") == 0)
+                gzip_.min_length =
+                    Utils::strToSize(token.substr(11), GZIP_MAX_FILE);
+              else if (token.compare(0, 6, "cache=") == 0)
+                gzip_.cache_size =
+                    Utils::strToSize(token.substr(6), FILE_CACHE_MAX_SIZE);
+              else if (token.compare(0, 6, "types=") == 0 &&
+                       token.size() > 6)
+              {
+                std::istringstream types(token.substr(6));
+                std::string type;
+                gzip_.types.clear();
+                while (std::getline(types, type, ','))
+                {
+                  if (type.find('/') == std::string::npos)
+                    throw Fatal("Invalid MIME type");
+                  std::for_each(type.begin(), type.end(), Utils::toLower);
+                  gzip_.types.insert(type);
+                }
+              }
+              else
+                throw Fatal("Unknown argument");
+            }
+            catch (const Fatal& e)
+            {
+              throw Fatal("Invalid config file format: invalid gzip argument "
+                          "=> " +
+                          token);
+            }
+          }
+        }
+        else
+          throw Fatal("Invalid config file format: invalid gzip value => " +
+                      token);
+      }
       else if (identifier_token == "cgi_path")
       {
         std::string extension;
@@ -224,6 +437,54 @@ void Configuration::parseConfigFile(const string& config_file)
           python_path_ = path;
         }
       }
+      else if (identifier_token == "cgi_pool")
+      {
+        std::string extension;
+        if (!(ss >> extension))
+          throw Fatal("Invalid config file format: expected cgi_pool value");
+        if (extension != ".php" && extension != ".py")
+          throw Fatal(
+              "Invalid config file format: invalid file extension in cgi_pool");
+        CgiPoolSettings& pool = extension == ".php" ? php_pool_ : python_pool_;
+        if (pool.configured)
+          throw Fatal("Invalid config file format: cgi_pool for " + extension +
+                      " already defined");
+        pool.configured = true;
+        std::string token;
+        while (ss >> token)
+        {
+          try
+          {
+            if (token.compare(0, 4, "max=") == 0)
+              pool.max = Utils::ipStrToUint32Max(token.substr(4), CGI_POOL_MAX);
+            else if (token.compare(0, 4, "min=") == 0)
+              pool.min = Utils::ipStrToUint32Max(token.substr(4), CGI_POOL_MAX);
+            else if (token.compare(0, 9, "requests=") == 0)
+              pool.max_requests =
+                  Utils::ipStrToUint32Max(token.substr(9), 0xffffffffU);
+            else if (token.compare(0, 5, "idle=") == 0)
+              pool.idle_timeout =
+                  Utils::ipStrToUint32Max(token.substr(5), CGI_POOL_IDLE_MAX);
+            else if (token.compare(0, 4, "bin=") == 0 && token.size() > 4 &&
+                     token[4] == '/')
+              pool.bin_path = token.substr(4);
+            else
+              throw Fatal("Unknown argument");
+          }
+          catch (const Fatal& e)
+          {
+            throw Fatal("Invalid config file format: invalid cgi_pool argument "
+                        "=> " +
+                        token);
+          }
+        }
+        if (pool.max == 0 || pool.min > pool.max)
+          throw Fatal("Invalid config file format: cgi_pool requires max=N "
+                      "with N > 0 and not below min");
+        if (extension == ".py" && pool.bin_path.empty())
+          throw Fatal("Invalid config file format: cgi_pool for .py requires "
+                      "bin=<absolute path> of a FastCGI server");
+      }
       else
       {
         throw Fatal("Invalid config file format: unknown global token => " +
@@ -297,6 +558,7 @@ void Configuration::process_server_block(const std::string& block)
         cursor = end + 1;  // weiter hinter der schließenden Klammer
       }
     }
+    config.location_trie.build(config.locations);
     server_configs_.push_back(config);
   }
   catch (std::exception& e)
@@ -351,6 +613,57 @@ void Configuration::process_location_block(std::stringstream& item,
   }
 }
 
+/*
+ * "unix:/path" or "host:port" (IPv6 addresses in brackets), host names are
+ * resolved once here and the first address is used
+ */
+static void resolve_fastcgi_pass(const string& token, FastCgiAddress& upstream)
+{
+  upstream.name = token;
+  if (token.compare(0, 5, "unix:") == 0)
+  {
+    string path = token.substr(5);
+    struct sockaddr_un* addr =
+        reinterpret_cast< struct sockaddr_un* >(&upstream.address);
+    if (path.empty() || path[0] != '/')
+      throw Fatal("Invalid config file format: fastcgi_pass requires an "
+                  "absolute socket path => " +
+                  token);
+    if (path.size() >= sizeof(addr->sun_path))
+      throw Fatal("Invalid config file format: fastcgi_pass socket path too "
+                  "long => " +
+                  token);
+    addr->sun_family = AF_UNIX;
+    std::memcpy(addr->sun_path, path.c_str(), path.size() + 1);
+    upstream.length = sizeof(struct sockaddr_un);
+    return;
+  }
+
+  string::size_type pos = token.find_last_of(':');
+  if (pos == string::npos || pos == 0)
+    throw Fatal("Invalid config file format: fastcgi_pass requires "
+                "unix:/path or host:port => " +
+                token);
+  string host = token.substr(0, pos);
+  if (host[0] == '[' && host[host.size() - 1] == ']')
+    host = host.substr(1, host.size() - 2);
+  if (Utils::ipStrToUint16(token.substr(pos + 1)) == 0)
+    throw Fatal("Invalid config file format: port cannot be 0");
+
+  struct addrinfo hints;
+  struct addrinfo* result;
+  std::memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), token.c_str() + pos + 1, &hints, &result) != 0)
+    throw Fatal("Invalid config file format: unable to resolve fastcgi_pass "
+                "=> " +
+                token);
+  std::memcpy(&upstream.address, result->ai_addr, result->ai_addrlen);
+  upstream.length = result->ai_addrlen;
+  freeaddrinfo(result);
+}
+
 void Configuration::process_location_item(std::stringstream& item,
                                           Location& loc)
 {
@@ -460,6 +773,27 @@ void Configuration::process_location_item(std::stringstream& item,
     loc.DIR_LISTING.second = true;
   }
 
+  // ── ◼︎ precompressed files ────────────────────────────────────────────────
+  else if (identifier == "gzip_static" || identifier == "brotli_static")
+  {
+    bool_pair& setting =
+        (identifier == "gzip_static") ? loc.gzip_static : loc.brotli_static;
+    if (tokens.size() != 1)
+      throw Fatal("Invalid config file format: " + identifier +
+                  " requires exactly 1 argument");
+    if (setting.second)
+      throw Fatal("Invalid config file format: " + identifier +
+                  " already defined");
+    if (tokens[0] == "on")
+      setting.first = true;
+    else if (tokens[0] == "off")
+      setting.first = false;
+    else
+      throw Fatal("Invalid config file format: invalid " + identifier +
+                  " value => " + tokens[0]);
+    setting.second = true;
+  }
+
   // ── ◼︎ client max body size ───────────────────────────────────────────────
   else if (identifier == "client_max_body_size")
   {
@@ -525,6 +859,37 @@ void Configuration::process_location_item(std::stringstream& item,
     loc.upload_dir = tokens[0];
   }
 
+  // ── ◼︎ FastCGI ────────────────────────────────────────────────────────────
+  else if (identifier == "fastcgi_pass")
+  {
+    if (loc.fastcgi_pass.configured())
+      throw Fatal("Invalid config file format: fastcgi_pass already defined");
+    if (tokens.size() != 1)
+      throw Fatal("Invalid config file format: fastcgi_pass requires exactly "
+                  "1 argument");
+    resolve_fastcgi_pass(tokens[0], loc.fastcgi_pass);
+  }
+
+  // ── ◼︎ CGI request body ───────────────────────────────────────────────────
+  else if (identifier == "cgi_request_buffering")
+  {
+    if (tokens.size() != 1)
+      throw Fatal("Invalid config file format: cgi_request_buffering requires "
+                  "exactly 1 argument");
+    if (loc.request_buffering.second)
+      throw Fatal("Invalid config file format: cgi_request_buffering already "
+                  "defined");
+    if (tokens[0] == "on")
+      loc.request_buffering.first = true;
+    else if (tokens[0] == "off")
+      loc.request_buffering.first = false;
+    else
+      throw Fatal("Invalid config file format: invalid cgi_request_buffering "
+                  "value => " +
+                  tokens[0]);
+    loc.request_buffering.second = true;
+  }
+
   // ── ◼︎ end / invalid token ──────────────────────────────────────────────────
   else if (identifier == "}")
     return;
@@ -534,6 +899,22 @@ void Configuration::process_location_item(std::stringstream& item,
         identifier);
 }
 
+/*
+ * A '*' is only allowed as the whole first ("*.example.com") or last
+ * ("example.*") label of a server name
+ */
+static bool validWildcard(const string& name)
+{
+  string::size_type star = name.find('*');
+
+  if (star == string::npos)
+    return true;
+  if (name.size() < 3 || name.find('*', star + 1) != string::npos)
+    return false;
+  return (star == 0 && name[1] == '.') ||
+         (star == name.size() - 1 && name[star - 1] == '.');
+}
+
 static void insert_ip(IpSet& ips, const string& token)
 {
   string::size_type pos = token.find_last_of(':');
@@ -622,6 +1003,8 @@ void Configuration::process_server_item(std::stringstream& item, Server& config)
       {
         std::pair< string, u_int16_t > host_port =
             Parsing::parseHost(tokens[i]);
+        if (!validWildcard(host_port.first))
+          throw Fatal("Invalid config file format: invalid wildcard");
         if (config.server_names.insert(host_port.first).second == false)
         {
           std::cerr << WARNING << "Duplicate server name, statement ignored => "
@@ -698,6 +1081,47 @@ void Configuration::printConfigurations() const
   std::cout << "-->Cgi timeout: " << cgi_timeout_.first << std::endl;
   std::cout << "-->Keep alive timeout: " << keep_alive_timeout_.first
             << std::endl;
+  std::cout << "-->Sendfile: " << (sendfile_.first ? "on" : "off")
+            << std::endl;
+  std::cout << "-->Worker processes: " << worker_processes_.first
+            << std::endl;
+  std::cout << "-->Open file cache: ";
+  if (open_file_cache_.max > 0)
+    std::cout << "max=" << open_file_cache_.max
+              << " valid=" << open_file_cache_.valid << std::endl;
+  else
+    std::cout << "off" << std::endl;
+  std::cout << "-->File cache: ";
+  if (file_cache_.max_size > 0)
+    std::cout << "max_size=" << file_cache_.max_size
+              << " max_file=" << file_cache_.max_file << std::endl;
+  else
+    std::cout << "off" << std::endl;
+  std::cout << "-->Gzip: ";
+  if (gzip_.enabled)
+  {
+    std::cout << "min_length=" << gzip_.min_length
+              << " cache=" << gzip_.cache_size << " types=";
+    for (std::set< std::string >::const_iterator it = gzip_.types.begin();
+         it != gzip_.types.end(); ++it)
+      std::cout << (it == gzip_.types.begin() ? "" : ",") << *it;
+    std::cout << std::endl;
+  }
+  else
+    std::cout << "off" << std::endl;
+  const CgiPoolSettings* pools[] = {&php_pool_, &python_pool_};
+  for (size_t i = 0; i < 2; ++i)
+  {
+    std::cout << "-->Cgi pool " << (i == 0 ? ".php" : ".py") << ": ";
+    if (pools[i]->max > 0)
+      std::cout << "min=" << pools[i]->min << " max=" << pools[i]->max
+                << " requests=" << pools[i]->max_requests
+                << " idle=" << pools[i]->idle_timeout
+                << (pools[i]->bin_path.empty() ? "" : " bin=")
+                << pools[i]->bin_path << std::endl;
+    else
+      std::cout << "off" << std::endl;
+  }
   std::cout << "server configs: " << std::endl;
   for (size_t i = 0; i < server_configs_.size(); ++i)
   {
@@ -788,6 +1212,8 @@ std::ostream& operator<<(std::ostream& os, const Location& loc)
 
   os << "---->Directory listing: " << (loc.DIR_LISTING.first ? "on" : "off")
      << std::endl;
+  os << "---->Precompressed: " << (loc.gzip_static.first ? "gzip " : "")
+     << (loc.brotli_static.first ? "br" : "") << std::endl;
   os << "---->Max body size: " << loc.max_body_size.first << std::endl;
   os << "---->CGI extensions: " << loc.cgi_extensions << std::endl;
   os << "---->Default files: " << loc.default_files << std::endl;
@@ -795,6 +1221,10 @@ std::ostream& operator<<(std::ostream& os, const Location& loc)
   os << loc.redirect << std::endl;
   os << "---->Root: " << loc.root << std::endl;
   os << "---->Upload dir: " << loc.upload_dir << std::endl;
+  if (loc.fastcgi_pass.configured())
+    os << "---->FastCGI: " << loc.fastcgi_pass.name << std::endl;
+  os << "---->CGI request buffering: "
+     << (loc.request_buffering.first ? "on" : "off") << std::endl;
   return os;
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 // ── ◼︎ includes ─────────────────────────────
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <cstddef>
 #include <map>
@@ -13,10 +14,24 @@
 
 #define CGI_TIMEOUT_MAX 300
 #define KEEP_ALIVE_TIMEOUT_MAX 60
+#define WORKER_PROCESSES_MAX 64
+#define OPEN_FILE_CACHE_MAX 100000
+#define OPEN_FILE_CACHE_VALID_MAX 3600
+#define OPEN_FILE_CACHE_VALID_DEFAULT 60
+#define FILE_CACHE_MAX_SIZE (16UL * 1024 * 1024 * 1024)
+#define FILE_CACHE_MAX_FILE_DEFAULT (64 * 1024)
+#define GZIP_MIN_LENGTH_DEFAULT 256
+#define GZIP_CACHE_SIZE_DEFAULT (16 * 1024 * 1024)
+#define GZIP_MAX_FILE (256 * 1024)  // Bigger static files aren't compressed
+#define CGI_POOL_MAX 256
+#define CGI_POOL_REQUESTS_DEFAULT 500
+#define CGI_POOL_IDLE_DEFAULT 60
+#define CGI_POOL_IDLE_MAX 3600
 
 // ── ◼︎ errorcodes implemented ───────────────────────
-static const u_int16_t error_codes[] = {400, 403, 404, 405, 408, 409, 411,
-                                        413, 414, 500, 501, 503, 504, 505};
+static const u_int16_t error_codes[] = {400, 403, 404, 405, 408,
+                                        409, 411, 413, 414, 500,
+                                        501, 502, 503, 504, 505};
 
 // ── ◼︎ invalid chars for servername ───────────────────────
 static const char invalid_server_name_chars[] = {
@@ -74,6 +89,94 @@ struct LogSettings
   std::string logfile;
 };
 
+/*
+ * `max` = 0 means the open file cache is disabled
+ */
+struct OpenFileCacheSettings
+{
+  OpenFileCacheSettings()
+      : configured(false), max(0), valid(OPEN_FILE_CACHE_VALID_DEFAULT)
+  {}
+
+  bool configured;
+  size_t max;
+  size_t valid;
+};
+
+/*
+ * `max_size` = 0 means the file cache is disabled
+ */
+struct FileCacheSettings
+{
+  FileCacheSettings()
+      : configured(false), max_size(0), max_file(FILE_CACHE_MAX_FILE_DEFAULT)
+  {}
+
+  bool configured;
+  size_t max_size;
+  size_t max_file;
+};
+
+/*
+ * On-the-fly compression of responses with one of the `types`. Static files
+ * are only compressed if the result fits into the cache, with `cache_size` =
+ * 0 just directory listings and CGI output are.
+ */
+struct GzipSettings
+{
+  GzipSettings()
+      : configured(false),
+        enabled(false),
+        min_length(GZIP_MIN_LENGTH_DEFAULT),
+        cache_size(GZIP_CACHE_SIZE_DEFAULT)
+  {
+    types.insert("text/html");
+    types.insert("text/plain");
+    types.insert("text/css");
+    types.insert("text/javascript");
+    types.insert("application/json");
+    types.insert("application/xml");
+    types.insert("image/svg+xml");
+  }
+
+  bool compresses(const std::string& type) const
+  {
+    return enabled && types.find(type) != types.end();
+  }
+
+  bool configured;
+  bool enabled;
+  size_t min_length;
+  std::set< std::string > types;
+  size_t cache_size;
+};
+
+/*
+ * Persistent interpreters for a `cgi_path`, `max` = 0 means every request
+ * forks a process of its own. The workers have to speak FastCGI, so they run
+ * `bin_path` if it's set (required for .py, python3 itself can't) and the
+ * `cgi_path` otherwise (php-cgi). Workers are retired after `max_requests`
+ * requests (0 = never) and when they have been idle for `idle_timeout`
+ * seconds while there are more than `min` of them.
+ */
+struct CgiPoolSettings
+{
+  CgiPoolSettings()
+      : configured(false),
+        min(0),
+        max(0),
+        max_requests(CGI_POOL_REQUESTS_DEFAULT),
+        idle_timeout(CGI_POOL_IDLE_DEFAULT)
+  {}
+
+  bool configured;
+  size_t min;
+  size_t max;
+  size_t max_requests;
+  size_t idle_timeout;
+  std::string bin_path;
+};
+
 // ── ◼︎ typedefs utils ───────────────────────
 typedef std::string string;
 typedef std::set< IpAddress*, IpComparison > IpSet;
@@ -107,6 +210,28 @@ struct Redirection
   string uri;
 };
 
+/*
+ * Upstream of `fastcgi_pass`, resolved at config load. `name` is the address
+ * as written in the config ("unix:/path" or "host:port") and identifies the
+ * connections that can be shared, `length` is 0 if the location doesn't pass
+ * its scripts to a FastCGI server. Without `keep_conn` every request gets a
+ * connection of its own that the server closes when it's done (CGI pool).
+ */
+struct FastCgiAddress
+{
+  FastCgiAddress() : name(), address(), length(0), keep_conn(true) {}
+
+  bool configured() const
+  {
+    return length > 0;
+  }
+
+  string name;
+  struct sockaddr_storage address;
+  socklen_t length;
+  bool keep_conn;
+};
+
 /// @brief Location configuration
 ///
 /// Booleans for HTTP methods:
@@ -114,12 +239,16 @@ struct Redirection
 /// - `POST`
 /// - `DELETE`
 /// `___DIR_LISTING` if directory listing is allowed
+/// `___gzip_static` serve precompressed `.gz` siblings
+/// `_brotli_static` serve precompressed `.br` siblings
 /// `_max_body_size` maximum body size
 /// `cgi_extensions` cgi extensions
 /// `_default_files` default files
 /// `_____redirects` redirections
 /// `__________root` root directory
 /// `____upload_dir` upload directory
+/// `__fastcgi_pass` FastCGI server for the cgi scripts
+/// `request_buffering` CGI gets the body from a temporary file, not a pipe
 struct Location
 {
   Location()
@@ -128,18 +257,24 @@ struct Location
         POST(false),
         DELETE(false),
         DIR_LISTING(false, false),
+        gzip_static(false, false),
+        brotli_static(false, false),
         max_body_size(0, false),
         cgi_extensions(),
         default_files(),
         redirect(),
         root(),
-        upload_dir()
+        upload_dir(),
+        fastcgi_pass(),
+        request_buffering(true, false)
   {}
   bool http_methods_set;
   bool GET;                       // http methods
   bool POST;                      // http methods
   bool DELETE;                    // http methods
   bool_pair DIR_LISTING;          // dir_listing active or not
+  bool_pair gzip_static;          // precompressed .gz files
+  bool_pair brotli_static;        // precompressed .br files
   size_pair max_body_size;        // in bytes
   SCgiExtensions cgi_extensions;  // cgi_extensions
   VDefaultFiles default_files;    // default_files
@@ -147,6 +282,37 @@ struct Location
   string root;                    // root
   string upload_dir;              // upload_dir
   string location_name;           // location name
+  FastCgiAddress fastcgi_pass;    // fastcgi_pass
+  bool_pair request_buffering;    // cgi_request_buffering
+};
+
+/*
+ * The locations of a server compiled into a character trie at config load,
+ * so the longest matching location is found with a single walk over the path
+ * and without allocating anything. It keeps its own copies of the locations,
+ * copying a Server (every listener has its own vector) doesn't leave it
+ * pointing into another one.
+ */
+class LocationTrie
+{
+ public:
+  LocationTrie();
+
+  void build(const MLocations& locations);
+  const Location* find(const string& path) const;
+
+ private:
+  struct Node
+  {
+    string labels;                // The next character of every child
+    std::vector< int > children;  // Node index per label
+    int location;                 // Index into locations_, -1 if none
+  };
+
+  std::vector< Node > nodes_;
+  std::vector< Location > locations_;
+
+  int addNode(void);
 };
 
 /// @brief `Server configuration`
@@ -157,12 +323,14 @@ struct Location
 /// `_______________ips` ip addresses
 /// `_______error_pages` error pages
 /// `_________locations` locations
+/// `____location_trie` locations compiled for matching
 struct Server
 {
-  ServerNames server_names;  // server_name
-  IpSet ips;                 // ipv4 or ipv6
-  MErrors error_pages;       // error_pages
-  MLocations locations;      // locations
+  ServerNames server_names;     // server_name
+  IpSet ips;                    // ipv4 or ipv6
+  MErrors error_pages;          // error_pages
+  MLocations locations;         // locations
+  LocationTrie location_trie;   // locations compiled for matching
 };
 
 typedef std::vector< Server > ServerVec;
@@ -175,8 +343,15 @@ class Configuration
   size_pair keep_alive_timeout_;
   string php_path_;
   string python_path_;
+  CgiPoolSettings php_pool_;
+  CgiPoolSettings python_pool_;
   LogSettings access_log_;
   LogSettings error_log_;
+  bool_pair sendfile_;
+  size_pair worker_processes_;
+  OpenFileCacheSettings open_file_cache_;
+  FileCacheSettings file_cache_;
+  GzipSettings gzip_;
   const string config_file_;
 
  public:
@@ -223,12 +398,45 @@ class Configuration
   {
     return python_path_;
   }
+  const CgiPoolSettings& getPhpPool() const
+  {
+    return php_pool_;
+  }
+  const CgiPoolSettings& getPythonPool() const
+  {
+    return python_pool_;
+  }
 
   size_t getKeepAliveTimeout() const
   {
     return keep_alive_timeout_.first;
   }
 
+  bool getSendfile() const
+  {
+    return sendfile_.first;
+  }
+
+  size_t getWorkerProcesses() const
+  {
+    return worker_processes_.first;
+  }
+
+  const OpenFileCacheSettings& getOpenFileCacheSettings() const
+  {
+    return open_file_cache_;
+  }
+
+  const FileCacheSettings& getFileCacheSettings() const
+  {
+    return file_cache_;
+  }
+
+  const GzipSettings& getGzipSettings() const
+  {
+    return gzip_;
+  }
+
   // ── ◼︎ Utilities  ───────────────────────
   static bool found_code(int code)
   {
@@ -0,0 +1,68 @@
+#include <cstring>
+#include "Configs.hpp"
+
+LocationTrie::LocationTrie()
+{
+  addNode();
+}
+
+void LocationTrie::build(const MLocations& locations)
+{
+  nodes_.clear();
+  locations_.clear();
+  addNode();
+
+  for (MLocations::const_iterator it = locations.begin();
+       it != locations.end(); ++it)
+  {
+    int node = 0;
+    for (string::const_iterator c = it->first.begin(); c != it->first.end();
+         ++c)
+    {
+      string::size_type label = nodes_[node].labels.find(*c);
+      if (label != string::npos)
+      {
+        node = nodes_[node].children[label];
+        continue;
+      }
+      int child = addNode();
+      nodes_[node].labels += *c;
+      nodes_[node].children.push_back(child);
+      node = child;
+    }
+    nodes_[node].location = static_cast< int >(locations_.size());
+    locations_.push_back(it->second);
+  }
+}
+
+/*
+ * An exact match wins, otherwise the longest location ending with a slash
+ * that is a prefix of `path`. Returns NULL if there is none.
+ */
+const Location* LocationTrie::find(const string& path) const
+{
+  const Location* match = NULL;
+  int node = 0;
+
+  for (string::size_type i = 0; i < path.size(); ++i)
+  {
+    const Node& current = nodes_[node];
+    const char* label = static_cast< const char* >(
+        std::memchr(current.labels.data(), path[i], current.labels.size()));
+    if (!label)
+      return match;
+    node = current.children[label - current.labels.data()];
+    if (path[i] == '/' && nodes_[node].location != -1)
+      match = &locations_[nodes_[node].location];
+  }
+  if (nodes_[node].location != -1)
+    return &locations_[nodes_[node].location];
+  return match;
+}
+
+int LocationTrie::addNode(void)
+{
+  nodes_.push_back(Node());
+  nodes_.back().location = -1;
+  return static_cast< int >(nodes_.size() - 1);
+}
@@ -0,0 +1,129 @@
+#include "VirtualHosts.hpp"
+#include <cctype>
+
+#define NAME_TABLE_MIN_SIZE 16
+
+void VirtualHosts::add(const Server& server)
+{
+  size_t index = servers_.size();
+
+  servers_.push_back(server);
+  for (ServerNames::const_iterator it = server.server_names.begin();
+       it != server.server_names.end(); ++it)
+  {
+    const std::string& name = *it;
+    if (name.size() > 2 && name.compare(0, 2, "*.") == 0)
+      leading_.insert(name.substr(1), index);
+    else if (name.size() > 2 && name.compare(name.size() - 2, 2, ".*") == 0)
+      trailing_.insert(name.substr(0, name.size() - 1), index);
+    else
+      exact_.insert(name, index);
+  }
+}
+
+/*
+ * Leading wildcards are tried from the first dot on, trailing ones from the
+ * last dot on, so the first hit is the longest match
+ */
+const Server& VirtualHosts::find(const std::string& host) const
+{
+  int index = exact_.find(host.data(), host.size());
+
+  for (std::string::size_type dot = host.find('.');
+       index == -1 && dot != std::string::npos; dot = host.find('.', dot + 1))
+    index = leading_.find(host.data() + dot, host.size() - dot);
+
+  for (std::string::size_type dot = host.rfind('.');
+       index == -1 && dot != std::string::npos && dot > 0;
+       dot = host.rfind('.', dot - 1))
+    index = trailing_.find(host.data(), dot + 1);
+
+  if (index == -1)
+    return servers_.front();
+  return servers_[index];
+}
+
+const ServerVec& VirtualHosts::servers() const
+{
+  return servers_;
+}
+
+VirtualHosts::NameTable::NameTable() : count_(0) {}
+
+void VirtualHosts::NameTable::insert(const std::string& name, size_t server)
+{
+  if (find(name.data(), name.size()) != -1)
+    return;
+  if ((count_ + 1) * 2 > slots_.size())
+    grow();
+
+  size_t mask = slots_.size() - 1;
+  size_t pos = hash(name.data(), name.size()) & mask;
+  while (slots_[pos].server != -1)
+    pos = (pos + 1) & mask;
+  slots_[pos].name = name;
+  for (std::string::iterator it = slots_[pos].name.begin();
+       it != slots_[pos].name.end(); ++it)
+    *it = static_cast< char >(std::tolower(static_cast< unsigned char >(*it)));
+  slots_[pos].server = static_cast< int >(server);
+  ++count_;
+}
+
+/*
+ * Returns the server index for `name`, -1 if it isn't in the table
+ */
+int VirtualHosts::NameTable::find(const char* name, size_t length) const
+{
+  if (slots_.empty())
+    return -1;
+
+  size_t mask = slots_.size() - 1;
+  for (size_t pos = hash(name, length) & mask; slots_[pos].server != -1;
+       pos = (pos + 1) & mask)
+  {
+    const std::string& candidate = slots_[pos].name;
+    if (candidate.size() != length)
+      continue;
+    size_t i = 0;
+    while (i < length &&
+           std::tolower(static_cast< unsigned char >(name[i])) == candidate[i])
+      ++i;
+    if (i == length)
+      return slots_[pos].server;
+  }
+  return -1;
+}
+
+/*
+ * FNV-1a over the lower case name
+ */
+size_t VirtualHosts::NameTable::hash(const char* name, size_t length)
+{
+  u_int32_t hash = 2166136261u;
+
+  for (size_t i = 0; i < length; ++i)
+  {
+    hash ^= std::tolower(static_cast< unsigned char >(name[i]));
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/*
+ * Doubles the table (keeping it at most half full) and reinserts everything
+ */
+void VirtualHosts::NameTable::grow(void)
+{
+  std::vector< Slot > old;
+  old.swap(slots_);
+
+  Slot empty;
+  empty.server = -1;
+  slots_.assign(old.empty() ? NAME_TABLE_MIN_SIZE : old.size() * 2, empty);
+  count_ = 0;
+  for (std::vector< Slot >::iterator it = old.begin(); it != old.end(); ++it)
+  {
+    if (it->server != -1)
+      insert(it->name, it->server);
+  }
+}
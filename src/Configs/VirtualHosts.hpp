@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Configs.hpp"
+
+/*
+ * The servers of one listener with their names indexed for the Host lookup.
+ * Exact names are looked up first, then "*.example.com" names (the longest
+ * one wins), then "example.*" names. Matching is case-insensitive, without a
+ * match the first server is the default.
+ */
+class VirtualHosts
+{
+ public:
+  void add(const Server& server);
+  const Server& find(const std::string& host) const;
+  const ServerVec& servers() const;
+
+ private:
+  /*
+   * Hash table (open addressing, linear probing) from a lower case name to
+   * the index of its server. The first server added with a name keeps it.
+   */
+  class NameTable
+  {
+   public:
+    NameTable();
+
+    void insert(const std::string& name, size_t server);
+    int find(const char* name, size_t length) const;
+
+   private:
+    struct Slot
+    {
+      std::string name;
+      int server;  // -1 for an empty slot
+    };
+
+    std::vector< Slot > slots_;
+    size_t count_;
+
+    static size_t hash(const char* name, size_t length);
+    void grow(void);
+  };
+
+  ServerVec servers_;
+  NameTable exact_;
+  NameTable leading_;   // "*.example.com" stored as ".example.com"
+  NameTable trailing_;  // "example.*" stored as "example."
+};
@@ -1,4 +1,6 @@
 #include "Logger.hpp"
+#include <fcntl.h>
+#include <unistd.h>
 #include <ctime>
 #include <fstream>
 #include <ios>
@@ -7,6 +9,7 @@
 #include <stdexcept>
 #include <string>
 #include "../exceptions/Fatal.hpp"
+#include "../utils/Spawn.hpp"
 
 using std::ios_base;
 
@@ -92,3 +95,20 @@ void Logger::close()
   if (logger.logfile_.is_open())
     logger.logfile_.close();
 }
+
+/*
+ * stderr of a CGI process goes to the error log if there is one and is
+ * closed otherwise. The access log is closed in the child anyway (all fds
+ * from 3 on are).
+ */
+void Logger::setupChildStderr(Utils::Spawn& spawn)
+{
+  const LogSettings& error_settings =
+      Configuration::getInstance().getErrorLogsettings();
+
+  if (!error_settings.configured)
+    spawn.close(STDERR_FILENO);
+  else if (error_settings.mode == LOGFILE)
+    spawn.open(STDERR_FILENO, error_settings.logfile,
+               O_CREAT | O_WRONLY | O_APPEND, 0644);
+}
@@ -5,6 +5,11 @@
 #include <string>
 #include "../Configs/Configs.hpp"
 
+namespace Utils
+{
+  class Spawn;
+}
+
 class Logger
 {
  public:
@@ -15,6 +20,7 @@ class Logger
   static void openFile(const std::string& filename);
   static void setLogMode(LogMode mode);
   static void close();
+  static void setupChildStderr(Utils::Spawn& spawn);
 
  private:
   LogMode mode_;
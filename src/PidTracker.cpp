@@ -47,6 +47,11 @@ void PidTracker::ping()
   }
 }
 
+bool PidTracker::empty() const
+{
+  return pids_.empty();
+}
+
 PidTracker& getPidTracker(void)
 {
   static PidTracker pidtracker;
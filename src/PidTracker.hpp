@@ -21,6 +21,7 @@ class PidTracker
 
   void killPid(pid_t pid);
   void ping();
+  bool empty() const;
 
  private:
   MPid pids_;
@@ -0,0 +1,70 @@
+#include "TimerQueue.hpp"
+
+TimerQueue::TimerQueue() {}
+
+TimerQueue::~TimerQueue() {}
+
+void TimerQueue::schedule(int fd, u_int64_t deadline, TimerType type)
+{
+  MTimers::iterator it = timers_.find(fd);
+
+  if (it != timers_.end())
+  {
+    if (it->second.deadline <= deadline)
+      return;
+    queue_.erase(std::make_pair(it->second.deadline, fd));
+  }
+
+  Timer timer = {deadline, type};
+  timers_[fd] = timer;
+  queue_.insert(std::make_pair(deadline, fd));
+}
+
+void TimerQueue::cancel(int fd)
+{
+  MTimers::iterator it = timers_.find(fd);
+
+  if (it == timers_.end())
+    return;
+  queue_.erase(std::make_pair(it->second.deadline, fd));
+  timers_.erase(it);
+}
+
+/*
+ * Returns the timeout for epoll_wait in milliseconds, -1 if there is nothing
+ * to wait for
+ */
+int TimerQueue::getWaitTimeout(u_int64_t current_time) const
+{
+  if (queue_.empty())
+    return -1;
+
+  u_int64_t next = queue_.begin()->first;
+  if (next <= current_time)
+    return 0;
+  return static_cast< int >((next - current_time) * 1000);
+}
+
+VExpiredTimers TimerQueue::popExpired(u_int64_t current_time)
+{
+  VExpiredTimers expired;
+
+  while (!queue_.empty() && queue_.begin()->first <= current_time)
+  {
+    int fd = queue_.begin()->second;
+    MTimers::iterator it = timers_.find(fd);
+
+    expired.push_back(std::make_pair(fd, it->second.type));
+    timers_.erase(it);
+    queue_.erase(queue_.begin());
+  }
+
+  return expired;
+}
+
+TimerQueue& getTimerQueue()
+{
+  static TimerQueue timers;
+
+  return timers;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <sys/types.h>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+enum TimerType
+{
+  CONNECTION_TIMER,
+  CGI_TIMER,
+  FASTCGI_TIMER
+};
+
+struct Timer
+{
+  u_int64_t deadline;
+  TimerType type;
+};
+
+typedef std::set< std::pair< u_int64_t, int > > STimerQueue;
+typedef std::map< int, Timer > MTimers;
+typedef std::vector< std::pair< int, TimerType > > VExpiredTimers;
+
+/*
+ * Ordered set of (deadline, fd) for every fd that can time out, deadlines in
+ * seconds. Only the fds that are actually due get touched when the timers are
+ * processed.
+ *
+ * Rescheduling to a later deadline is a no-op, the timer will just fire early
+ * and the owner has to check whether it really expired and schedule it again.
+ * That way the queue doesn't need to be touched on every single read/write.
+ */
+class TimerQueue
+{
+ public:
+  TimerQueue();
+  ~TimerQueue();
+
+  void schedule(int fd, u_int64_t deadline, TimerType type);
+  void cancel(int fd);
+  int getWaitTimeout(u_int64_t current_time) const;
+  VExpiredTimers popExpired(u_int64_t current_time);
+
+ private:
+  STimerQueue queue_;
+  MTimers timers_;
+
+  TimerQueue(const TimerQueue& other);
+  TimerQueue& operator=(const TimerQueue& other);
+};
+
+TimerQueue& getTimerQueue();
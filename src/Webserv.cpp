@@ -1,6 +1,9 @@
+#include "CgiPool.hpp"
 #include "PidTracker.hpp"
+#include "TimerQueue.hpp"
 #include "epoll/EpollData.hpp"
 
+#include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
 #include <sys/epoll.h>
@@ -19,9 +22,12 @@
 #include "Configs/Configs.hpp"
 #include "Logger/Logger.hpp"
 #include "Webserv.hpp"
+#include "cache/FileCache.hpp"
+#include "cache/OpenFileCache.hpp"
 #include "epoll/Connection.hpp"
 #include "epoll/EpollAction.hpp"
 #include "epoll/EpollFd.hpp"
+#include "epoll/FastCgiConnection.hpp"
 #include "epoll/Listener.hpp"
 #include "epoll/PipeFd.hpp"
 #include "exceptions/ConError.hpp"
@@ -36,6 +42,10 @@
 
 #define KEEPALIVE_TIMEOUT_SECONDS 30
 
+// Workers dying faster than this are considered a startup failure (e.g. bind
+// failed) instead of a crash, so they won't be respawned in an endless loop
+#define WORKER_MIN_LIFETIME 2
+
 /*
  * The `size` argument in epoll_create is just for backwards compatibility.
  * Doesn't do anything since Linux kernel v2.6.8, only needs to be greater
@@ -56,6 +66,13 @@ Webserv::Webserv(std::string config_file, Configuration& config)
     throw;
   }
   servers_ = config_.getServerConfigs();
+
+  const OpenFileCacheSettings& cache = config_.getOpenFileCacheSettings();
+  getOpenFileCache().configure(cache.max, cache.valid);
+  const FileCacheSettings& files = config_.getFileCacheSettings();
+  getFileCache().configure(files.max_size, files.max_file);
+  const GzipSettings& gzip = config_.getGzipSettings();
+  getGzipCache().configure(gzip.enabled ? gzip.cache_size : 0, GZIP_MAX_FILE);
 }
 
 Webserv::~Webserv()
@@ -82,14 +99,14 @@ Listener& Webserv::getListener(IpAddress* addr)
 
   if (fd_it != listeners_.end())
   {
-    listener = static_cast< Listener* >(ed_.fds[fd_it->second]);
+    listener = static_cast< Listener* >(ed_.fds.find(fd_it->second));
   }
   else
   {
     listener = new Listener(addr);
     int fd = listener->getFd();
     listeners_[addr] = fd;
-    ed_.fds[fd] = listener;
+    ed_.fds.insert(fd, listener);
   }
 
   return *listener;
@@ -102,7 +119,7 @@ void Webserv::addFd(int fd, struct epoll_event* event)
     throw std::runtime_error("Unable to add fd to epoll");
   }
 
-  ed_.fds[fd] = static_cast< EpollFd* >(event->data.ptr);
+  ed_.fds.insert(fd, static_cast< EpollFd* >(event->data.ptr));
 }
 
 void Webserv::modifyFd(int fd, struct epoll_event* event) const
@@ -115,14 +132,16 @@ void Webserv::modifyFd(int fd, struct epoll_event* event) const
 
 void Webserv::deleteFd(int fd)
 {
-  if (ed_.fds.find(fd) == ed_.fds.end())
+  EpollFd* epoll_fd = ed_.fds.find(fd);
+  if (!epoll_fd)
     return;
   if (epoll_ctl(ed_.fd, EPOLL_CTL_DEL, fd, NULL) == -1)
   {
     throw std::runtime_error("Unable to remove fd from epoll");
   }
 
-  delete ed_.fds[fd];
+  getTimerQueue().cancel(fd);
+  delete epoll_fd;
   ed_.fds.erase(fd);
 }
 
@@ -138,15 +157,106 @@ void Webserv::addServers()
 
 void Webserv::addFdsToEpoll() const
 {
-  typedef std::map< int, EpollFd* >::const_iterator iter_type;
-
-  for (iter_type it = ed_.fds.begin(); it != ed_.fds.end(); ++it)
+  for (int fd = 0; fd < ed_.fds.getCapacity(); ++fd)
   {
-    epoll_ctl(ed_.fd, EPOLL_CTL_ADD, it->first, it->second->getEvent());
+    EpollFd* epoll_fd = ed_.fds.find(fd);
+    if (epoll_fd)
+      epoll_ctl(ed_.fd, EPOLL_CTL_ADD, fd, epoll_fd->getEvent());
   }
 }
 
 void Webserv::mainLoop()
+{
+  size_t worker_count = config_.getWorkerProcesses();
+
+  if (worker_count > 1)
+    runMaster(worker_count);
+  else
+    runWorker();
+}
+
+/*
+ * The master process doesn't handle any connections itself, it only forks the
+ * workers (each of them opening its own SO_REUSEPORT listeners and epoll
+ * instance) and respawns them if they die.
+ */
+void Webserv::runMaster(size_t worker_count)
+{
+  extern volatile sig_atomic_t g_signal;
+
+  for (size_t i = 0; i < worker_count; ++i)
+  {
+    if (spawnWorker())
+      return runWorker();
+  }
+
+  while (!g_signal)
+  {
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    MWorkers::iterator it = workers_.find(pid);
+    if (it == workers_.end())
+      continue;
+    u_int64_t started = it->second;
+    workers_.erase(it);
+    if (g_signal)
+      break;
+
+    if (Utils::getCurrentTime() - started < WORKER_MIN_LIFETIME)
+    {
+      stopWorkers();
+      throw Fatal("Worker process died during startup");
+    }
+    std::cerr << "Worker " << pid << " exited, respawning\n";
+    if (spawnWorker())
+      return runWorker();
+  }
+
+  stopWorkers();
+}
+
+/*
+ * Returns true in the child process
+ */
+bool Webserv::spawnWorker()
+{
+  pid_t pid = fork();
+
+  if (pid == -1)
+  {
+    stopWorkers();
+    throw Fatal("Unable to fork worker process");
+  }
+  else if (pid == 0)
+  {
+    workers_.clear();
+    ed_.reopen();
+    return true;
+  }
+
+  workers_[pid] = Utils::getCurrentTime();
+  return false;
+}
+
+void Webserv::stopWorkers()
+{
+  MWorkers::iterator it;
+
+  for (it = workers_.begin(); it != workers_.end(); ++it)
+    kill(it->first, SIGTERM);
+  for (it = workers_.begin(); it != workers_.end(); ++it)
+    waitpid(it->first, NULL, 0);
+  workers_.clear();
+}
+
+void Webserv::runWorker()
 {
   extern volatile sig_atomic_t g_signal;
 
@@ -159,9 +269,22 @@ void Webserv::mainLoop()
   else if (logsettings.configured)
     Logger::setLogMode(logsettings.mode);
 
+  PidTracker& pidtracker = getPidTracker();
+  TimerQueue& timers = getTimerQueue();
+
   while (true)
   {
-    int count = epoll_wait(ed_.fd, events_, MAX_EVENTS, 1000);
+    u_int64_t current_time = Utils::getCurrentTime();
+    bool pools_busy = getPhpPool().maintain(current_time);
+    pools_busy = getPythonPool().maintain(current_time) || pools_busy;
+    int timeout = timers.getWaitTimeout(current_time);
+    // Killed CGI processes still need to be reaped once per second, idle pool
+    // workers be stopped
+    if ((!pidtracker.empty() || pools_busy) &&
+        (timeout == -1 || timeout > 1000))
+      timeout = 1000;
+    int count = epoll_wait(ed_.fd, events_, MAX_EVENTS, timeout);
+    Utils::updateDateLine();
 
     if (g_signal || count == -1)
     {
@@ -210,90 +333,150 @@ void Webserv::mainLoop()
       }
     }
 
-    PidTracker& pidtracker = getPidTracker();
     pidtracker.ping();
-    pingAllClients(needed_fds);
+    processTimeouts();
+    if (needed_fds > 0)
+      closeClientConnections(needed_fds);
   }
 }
 
 /*
- * Sends a ping to every connected client, sets responses to timeout messages if
- * needed (if it takes too long to send the headers). If a client is currently
- * in keep-alive state, it will be pushed onto a multimap, and it will be closed
- * if a) it is in keep-alive state for too long, or b) the server needs more fds
- * (it will close the fds who are in keepalive state the longest first).
+ * Handles all the fds whose deadline has been reached. Connections will either
+ * get a timeout response (if it takes too long to send the headers) or get
+ * closed, CGIs running for too long will be killed.
  */
-void Webserv::pingAllClients(size_t needed_fds)
+void Webserv::processTimeouts()
 {
-  EpollMap::iterator it;
-  MMKeepAlive keepalive_fds;
-  std::vector< PipeFd* > delete_pipe_fds;
+  u_int64_t current_time = Utils::getCurrentTime();
+  VExpiredTimers expired = getTimerQueue().popExpired(current_time);
 
-  for (it = ed_.fds.begin(); it != ed_.fds.end(); ++it)
+  for (size_t i = 0; i < expired.size(); ++i)
   {
-    Connection* c = dynamic_cast< Connection* >(it->second);
-    if (c)
-    {
-      std::pair< EpollAction, u_int64_t > action_time = c->ping();
-      if (action_time.first.op == EPOLL_ACTION_MOD)
-      {
-        modifyFd(action_time.first.fd, action_time.first.event);
-        continue;
-      }
-
-      if (action_time.second > 0)
-      {
-        keepalive_fds.insert(
-            MMKeepAlive::value_type(action_time.second, action_time.first.fd));
-      }
-    }
+    EpollFd* epoll_fd = ed_.fds.find(expired[i].first);
+    if (!epoll_fd)
+      continue;
+
+    if (expired[i].second == CONNECTION_TIMER)
+      handleConnectionTimeout(static_cast< Connection* >(epoll_fd),
+                              current_time);
+    else if (expired[i].second == FASTCGI_TIMER)
+      handleFastCgiTimeout(static_cast< FastCgiConnection* >(epoll_fd),
+                           current_time);
     else
-    {
-      PipeFd* pipe_fd = dynamic_cast< PipeFd* >(it->second);
-      if (pipe_fd)
-      {
-        size_t time = Utils::getCurrentTime() - pipe_fd->getStartTime();
-        if (time > config_.getCgiTimeout())
-          delete_pipe_fds.push_back(pipe_fd);
-      }
-    }
+      handleCgiTimeout(static_cast< PipeFd* >(epoll_fd), current_time);
+  }
+}
+
+void Webserv::handleConnectionTimeout(Connection* connection,
+                                      u_int64_t current_time)
+{
+  EpollAction action = connection->ping(current_time);
+
+  if (action.op == EPOLL_ACTION_DEL)
+  {
+    std::cerr << "Closing fd " << action.fd << " (Timeout reached)\n";
+    deleteFd(action.fd);
+    return;
   }
+  if (action.op == EPOLL_ACTION_MOD)
+    modifyFd(action.fd, action.event);
+  getTimerQueue().schedule(action.fd, connection->getDeadline(),
+                           CONNECTION_TIMER);
+}
 
-  for (size_t i = 0; i < delete_pipe_fds.size(); ++i)
+/*
+ * A pipe without response only waits for the hangup of the killed script
+ */
+void Webserv::handleCgiTimeout(PipeFd* pipe_fd, u_int64_t current_time)
+{
+  CgiResponse* response = static_cast< CgiResponse* >(pipe_fd->getResponse());
+  if (!response)
   {
-    PipeFd* pipe_fd = delete_pipe_fds[i];
-    CgiResponse* response = static_cast< CgiResponse* >(pipe_fd->getResponse());
-    EpollFd* connection = ed_.fds[pipe_fd->getResponse()->getClientFd()];
     deleteFd(pipe_fd->getFd());
-    if (response->headersSent())
-    {
-      deleteFd(connection->getFd());
-    }
-    else
-    {
-      static_cast< Connection* >(connection)
-          ->getRequest()
-          .setResponse(new StaticResponse(connection->getFd(), 504, true));
-    }
+    return;
   }
-  closeClientConnections(keepalive_fds, needed_fds);
+  if (current_time < pipe_fd->getDeadline())
+  {
+    getTimerQueue().schedule(pipe_fd->getFd(), pipe_fd->getDeadline(),
+                             CGI_TIMER);
+    return;
+  }
+
+  deleteFd(pipe_fd->getFd());
+  cancelCgiResponse(response);
 }
 
-void Webserv::closeClientConnections(const MMKeepAlive& keepalive_fds,
-                                     size_t needed_fds)
+/*
+ * The requests that timed out get aborted one by one, the connection itself
+ * only gets closed once it's been idle for too long or the server stopped
+ * responding altogether
+ */
+void Webserv::handleFastCgiTimeout(FastCgiConnection* upstream,
+                                   u_int64_t current_time)
 {
+  std::vector< CgiResponse* > expired;
+  bool keep = upstream->expire(current_time, expired);
+
+  for (size_t i = 0; i < expired.size(); ++i)
+    cancelCgiResponse(expired[i]);
+  if (!keep)
+  {
+    deleteFd(upstream->getFd());
+    return;
+  }
+  getTimerQueue().schedule(upstream->getFd(), upstream->getDeadline(),
+                           FASTCGI_TIMER);
+}
+
+/*
+ * Replaces the response of a timed out CGI with a 504, if its headers went
+ * out already all that's left is closing the connection. A connection still
+ * streaming the request body to the CGI only polls for reading so far.
+ */
+void Webserv::cancelCgiResponse(CgiResponse* response)
+{
+  EpollFd* connection = ed_.fds.find(response->getClientFd());
+
+  if (response->headersSent())
+  {
+    deleteFd(connection->getFd());
+  }
+  else
+  {
+    Connection* client = static_cast< Connection* >(connection);
+    client->getRequest().setResponse(
+        new StaticResponse(client->getFd(), 504, true));
+    EpollAction action = client->pollForWriting();
+    if (action.op == EPOLL_ACTION_MOD)
+      modifyFd(action.fd, action.event);
+  }
+}
+
+/*
+ * Only called when the server ran out of fds. Closes the connections which
+ * are in keep-alive state the longest first.
+ */
+void Webserv::closeClientConnections(size_t needed_fds)
+{
+  MMKeepAlive keepalive_fds;
+  u_int64_t current_time = Utils::getCurrentTime();
+
+  for (Connection* c = ed_.connections; c; c = c->getNextConnection())
+  {
+    if (c->getKeepAliveSince() > 0)
+    {
+      keepalive_fds.insert(MMKeepAlive::value_type(
+          current_time - c->getKeepAliveSince(), c->getFd()));
+    }
+  }
+
   MMKeepAlive::const_iterator it = keepalive_fds.begin();
   size_t total_closed = 0;
-  size_t time_limit = config_.getKeepAliveTimeout();
 
-  while (it != keepalive_fds.end() &&
-         (it->first > time_limit || total_closed < needed_fds))
+  while (it != keepalive_fds.end() && total_closed < needed_fds)
   {
-    std::cerr << "Closing fd " << it->second;
-    if (it->first > time_limit)
-      std::cerr << "(Keepalive timeout reached)\n";
-    else
-      std::cerr << "(Keepalive state and more fds needed)\n";
+    std::cerr << "Closing fd " << it->second
+              << " (Keepalive state and more fds needed)\n";
     deleteFd(it->second);
     total_closed++;
     ++it;
@@ -6,8 +6,11 @@
 #include <map>
 #include <vector>
 #include "Configs/Configs.hpp"
+#include "epoll/Connection.hpp"
 #include "epoll/EpollData.hpp"
+#include "epoll/FastCgiConnection.hpp"
 #include "epoll/Listener.hpp"
+#include "epoll/PipeFd.hpp"
 #include "ip/IpAddress.hpp"
 #include "ip/IpComparison.hpp"
 
@@ -16,6 +19,7 @@ typedef std::set< IpAddress*, IpComparison > IpSet;
 typedef std::map< const IpAddress*, filedescriptor, IpComparison > ListenerMap;
 typedef std::vector< Server > VServers;
 typedef std::multimap< u_int64_t, int, std::greater< u_int64_t > > MMKeepAlive;
+typedef std::map< pid_t, u_int64_t > MWorkers;
 
 class Webserv
 {
@@ -34,6 +38,7 @@ class Webserv
   struct epoll_event* events_;
   VServers servers_;
   Configuration& config_;
+  MWorkers workers_;
 
   // Copy constructor and copy assignment are unused anyway, thus private
   Webserv(const Server& other);
@@ -42,9 +47,18 @@ class Webserv
   Listener& getListener(IpAddress* addr);
   void addServers();
   void addFdsToEpoll() const;
+  void runWorker();
+  void runMaster(size_t worker_count);
+  bool spawnWorker();
+  void stopWorkers();
   void addFd(int fd, struct epoll_event* event);
   void modifyFd(int fd, struct epoll_event* event) const;
   void deleteFd(int fd);
-  void pingAllClients(size_t needed_fds);
-  void closeClientConnections(const MMKeepAlive& fds, size_t needed_fds);
+  void processTimeouts();
+  void handleConnectionTimeout(Connection* connection, u_int64_t current_time);
+  void handleCgiTimeout(PipeFd* pipe_fd, u_int64_t current_time);
+  void handleFastCgiTimeout(FastCgiConnection* upstream,
+                            u_int64_t current_time);
+  void cancelCgiResponse(CgiResponse* response);
+  void closeClientConnections(size_t needed_fds);
 };
@@ -0,0 +1,108 @@
+#include "FileCache.hpp"
+#include "../requests/PathValidation/FileTypes.hpp"
+
+FileCache::FileCache() : size_(0), max_size_(0), max_file_(0) {}
+
+FileCache::~FileCache()
+{
+  while (!lru_.empty())
+    remove(lru_.front());
+}
+
+void FileCache::configure(size_t max_size, size_t max_file)
+{
+  max_size_ = max_size;
+  max_file_ = max_file;
+}
+
+bool FileCache::enabled(void) const
+{
+  return max_size_ > 0;
+}
+
+/*
+ * Whether a file of `size` bytes should be put into the cache
+ */
+bool FileCache::accepts(off_t size) const
+{
+  return max_size_ > 0 && size >= 0 &&
+         static_cast< size_t >(size) <= max_file_ &&
+         static_cast< size_t >(size) <= max_size_;
+}
+
+/*
+ * Returns the cached response for `path` with an additional reference (to be
+ * released by the caller), or NULL if there's none or it's outdated.
+ */
+Utils::SharedBuffer* FileCache::find(const std::string& path,
+                                     const PathInfos& infos)
+{
+  MCachedBodies::iterator it = bodies_.find(path);
+  if (it == bodies_.end())
+    return NULL;
+
+  CachedBody* body = it->second;
+  if (!infos.exists || infos.types != REGULAR_FILE || !infos.readable ||
+      infos.size != body->size || infos.mtime != body->mtime ||
+      infos.inode != body->inode)
+  {
+    remove(body);
+    return NULL;
+  }
+
+  lru_.splice(lru_.begin(), lru_, body->lru);
+  body->response->retain();
+  return body->response;
+}
+
+void FileCache::insert(const std::string& path,
+                       const PathInfos& infos,
+                       Utils::SharedBuffer* response)
+{
+  invalidate(path);
+
+  CachedBody* body = new CachedBody();
+  body->path = path;
+  body->size = infos.size;
+  body->mtime = infos.mtime;
+  body->inode = infos.inode;
+  body->response = response;
+  response->retain();
+
+  lru_.push_front(body);
+  body->lru = lru_.begin();
+  bodies_[path] = body;
+  size_ += response->data().size();
+  while (size_ > max_size_ && lru_.back() != body)
+    remove(lru_.back());
+}
+
+void FileCache::invalidate(const std::string& path)
+{
+  MCachedBodies::iterator it = bodies_.find(path);
+  if (it != bodies_.end())
+    remove(it->second);
+}
+
+void FileCache::remove(CachedBody* body)
+{
+  bodies_.erase(body->path);
+  lru_.erase(body->lru);
+  size_ -= body->response->data().size();
+  body->response->release();
+  delete body;
+}
+
+FileCache& getFileCache()
+{
+  static FileCache cache;
+
+  return cache;
+}
+
+FileCache& getGzipCache()
+{
+  static FileCache cache;
+
+  return cache;
+}
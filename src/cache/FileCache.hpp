@@ -0,0 +1,66 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <string>
+#include "../requests/PathValidation/PathInfos.hpp"
+#include "../utils/SharedBuffer.hpp"
+
+struct CachedBody
+{
+  std::string path;
+  off_t size;
+  time_t mtime;
+  ino_t inode;
+  Utils::SharedBuffer* response;  // Content headers and body of the file
+  std::list< CachedBody* >::iterator lru;
+};
+
+typedef std::map< std::string, CachedBody* > MCachedBodies;
+typedef std::list< CachedBody* > LCachedBodies;
+
+/*
+ * Keeps the contents of small files in memory, together with their already
+ * rendered Content-Length/ETag headers, so a hit can be sent without touching
+ * the disk. The key is the path on disk, so all servers/locations sharing a
+ * root also share the cached files. A second instance holds the gzip
+ * compressed versions, still keyed and validated by the original file.
+ *
+ * Entries are checked against the stat data of the open file cache on every
+ * lookup and dropped if the file changed. Once the cached bodies exceed
+ * `max_size` bytes, the least recently used ones get evicted. Since the
+ * buffers are reference counted, responses still sending an evicted body
+ * keep it alive.
+ */
+class FileCache
+{
+ public:
+  FileCache();
+  ~FileCache();
+
+  void configure(size_t max_size, size_t max_file);
+  bool enabled(void) const;
+  bool accepts(off_t size) const;
+  Utils::SharedBuffer* find(const std::string& path, const PathInfos& infos);
+  void insert(const std::string& path,
+              const PathInfos& infos,
+              Utils::SharedBuffer* response);
+  void invalidate(const std::string& path);
+
+ private:
+  MCachedBodies bodies_;
+  LCachedBodies lru_;  // Most recently used first
+  size_t size_;
+  size_t max_size_;
+  size_t max_file_;
+
+  void remove(CachedBody* body);
+
+  FileCache(const FileCache& other);
+  FileCache& operator=(const FileCache& other);
+};
+
+FileCache& getFileCache();
+FileCache& getGzipCache();
@@ -0,0 +1,226 @@
+#include "OpenFileCache.hpp"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "../exceptions/RequestError.hpp"
+#include "../requests/PathValidation/PathValidation.hpp"
+#include "../utils/Utils.hpp"
+
+OpenFileCache::OpenFileCache() : max_(0), valid_(0) {}
+
+OpenFileCache::~OpenFileCache()
+{
+  while (!lru_.empty())
+    remove(lru_.front());
+}
+
+void OpenFileCache::configure(size_t max, u_int64_t valid)
+{
+  max_ = max;
+  valid_ = valid;
+}
+
+/*
+ * Same as the global getFileType(), but answered from the cache if possible
+ */
+PathInfos OpenFileCache::getFileType(const std::string& path)
+{
+  if (max_ == 0)
+    return ::getFileType(path);
+
+  CachedFile* file = lookup(path);
+  if (file)
+    return file->infos;
+
+  PathInfos infos = ::getFileType(path);
+  if (infos.exists)
+    insert(path, infos);
+  return infos;
+}
+
+/*
+ * Returns the entry for `path` with an open fd. Every successful call has to
+ * be paired with a call to release().
+ */
+CachedFile* OpenFileCache::open(const std::string& path)
+{
+  CachedFile* file = NULL;
+
+  if (max_ > 0)
+    file = lookup(path);
+  if (!file)
+  {
+    PathInfos infos = ::getFileType(path);
+    if (!infos.exists)
+      throw RequestError(404, "File doesn't exist or isn't a regular file");
+    if (max_ > 0)
+      file = insert(path, infos);
+    else
+    {
+      file = new CachedFile();
+      file->path = path;
+      file->infos = infos;
+      file->fd = -1;
+      file->valid_until = 0;
+      file->users = 0;
+      file->cached = false;
+    }
+  }
+
+  try
+  {
+    if (file->infos.types == REGULAR_FILE && !file->infos.readable)
+      throw RequestError(403, "File is not readable");
+    else if (file->infos.types != REGULAR_FILE)
+      throw RequestError(404, "File doesn't exist or isn't a regular file");
+    if (file->fd == -1)
+      openFd(file);
+  }
+  catch (RequestError& e)
+  {
+    if (!file->cached)
+      delete file;
+    throw;
+  }
+
+  ++file->users;
+  return file;
+}
+
+void OpenFileCache::release(CachedFile* file)
+{
+  --file->users;
+  if (file->users == 0 && !file->cached)
+  {
+    if (file->fd != -1)
+      close(file->fd);
+    delete file;
+  }
+}
+
+/*
+ * Has to be called whenever the server itself modifies or deletes a file
+ */
+void OpenFileCache::invalidate(const std::string& path)
+{
+  MCachedFiles::iterator it = files_.find(path);
+  if (it != files_.end())
+    remove(it->second);
+}
+
+CachedFile* OpenFileCache::lookup(const std::string& path)
+{
+  MCachedFiles::iterator it = files_.find(path);
+  if (it == files_.end())
+    return NULL;
+
+  CachedFile* file = it->second;
+  u_int64_t now = Utils::getCurrentTime();
+  if (now >= file->valid_until)
+  {
+    PathInfos infos = ::getFileType(path);
+    if (!infos.exists || infos.types != file->infos.types ||
+        infos.inode != file->infos.inode || infos.size != file->infos.size ||
+        infos.mtime != file->infos.mtime)
+    {
+      remove(file);
+      return NULL;
+    }
+    file->infos = infos;  // Permissions might have changed
+    file->valid_until = now + valid_;
+  }
+  lru_.splice(lru_.begin(), lru_, file->lru);
+  return file;
+}
+
+CachedFile* OpenFileCache::insert(const std::string& path,
+                                  const PathInfos& infos)
+{
+  CachedFile* file = new CachedFile();
+  file->path = path;
+  file->infos = infos;
+  file->fd = -1;
+  file->valid_until = Utils::getCurrentTime() + valid_;
+  file->users = 0;
+  file->cached = true;
+
+  lru_.push_front(file);
+  file->lru = lru_.begin();
+  files_[path] = file;
+  if (files_.size() > max_)
+    remove(lru_.back());
+  return file;
+}
+
+/*
+ * Drops the entry from the cache, it only gets deleted once no response is
+ * using its fd anymore
+ */
+void OpenFileCache::remove(CachedFile* file)
+{
+  files_.erase(file->path);
+  lru_.erase(file->lru);
+  file->cached = false;
+  if (file->users == 0)
+  {
+    if (file->fd != -1)
+      close(file->fd);
+    delete file;
+  }
+}
+
+/*
+ * Gives back the fds of all cached files that aren't in use at the moment
+ */
+void OpenFileCache::closeIdleFiles(void)
+{
+  for (LCachedFiles::iterator it = lru_.begin(); it != lru_.end(); ++it)
+  {
+    if ((*it)->users == 0 && (*it)->fd != -1)
+    {
+      close((*it)->fd);
+      (*it)->fd = -1;
+    }
+  }
+}
+
+/*
+ * The size and inode get taken from the opened fd, in case the file was
+ * replaced since it was stat()ed.
+ */
+void OpenFileCache::openFd(CachedFile* file)
+{
+  int fd = ::open(file->path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd == -1 && (errno == ENFILE || errno == EMFILE))
+  {
+    closeIdleFiles();
+    fd = ::open(file->path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  }
+  if (fd == -1)
+  {
+    if (errno == ELOOP)
+      throw RequestError(403, "Requested file is a symlink");
+    else if (errno == ENFILE || errno == EMFILE)
+      throw RequestError(503, "Server ran out of fds");
+    throw RequestError(500, "Open failed for unknown reason");
+  }
+
+  struct stat statbuf;
+  if (fstat(fd, &statbuf) == -1)
+  {
+    close(fd);
+    throw RequestError(500, "Fstat failed for unknown reason");
+  }
+  file->fd = fd;
+  file->infos.size = statbuf.st_size;
+  file->infos.mtime = statbuf.st_mtime;
+  file->infos.inode = statbuf.st_ino;
+}
+
+OpenFileCache& getOpenFileCache()
+{
+  static OpenFileCache cache;
+
+  return cache;
+}
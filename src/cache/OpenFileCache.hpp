@@ -0,0 +1,65 @@
+#pragma once
+
+#include <sys/types.h>
+#include <list>
+#include <map>
+#include <string>
+#include "../requests/PathValidation/PathInfos.hpp"
+
+struct CachedFile
+{
+  std::string path;
+  PathInfos infos;
+  int fd;                 // -1 until the file gets opened the first time
+  u_int64_t valid_until;  // Needs to be revalidated with stat() afterwards
+  size_t users;           // Responses currently reading from `fd`
+  bool cached;  // False once evicted, then it's deleted by the last user
+  std::list< CachedFile* >::iterator lru;
+};
+
+typedef std::map< std::string, CachedFile* > MCachedFiles;
+typedef std::list< CachedFile* > LCachedFiles;
+
+/*
+ * Caches the results of getFileType() and the fds of opened files per path,
+ * so a hot file can be served without any stat(), access() or open() calls.
+ *
+ * Entries are trusted for `valid` seconds, afterwards they are checked with
+ * getFileType() again and only replaced if the file changed (different inode,
+ * size or mtime). Files that don't exist aren't cached. If there are more than
+ * `max` entries, the least recently used ones get dropped. Since responses
+ * share the fds, they must never rely on the file offset (pread/sendfile with
+ * an explicit offset only).
+ *
+ * With `max` set to 0 the cache is disabled and open() hands out a fresh fd
+ * for every request.
+ */
+class OpenFileCache
+{
+ public:
+  OpenFileCache();
+  ~OpenFileCache();
+
+  void configure(size_t max, u_int64_t valid);
+  PathInfos getFileType(const std::string& path);
+  CachedFile* open(const std::string& path);
+  void release(CachedFile* file);
+  void invalidate(const std::string& path);
+
+ private:
+  MCachedFiles files_;
+  LCachedFiles lru_;  // Most recently used first
+  size_t max_;
+  u_int64_t valid_;
+
+  CachedFile* lookup(const std::string& path);
+  CachedFile* insert(const std::string& path, const PathInfos& infos);
+  void remove(CachedFile* file);
+  void closeIdleFiles(void);
+  void openFd(CachedFile* file);
+
+  OpenFileCache(const OpenFileCache& other);
+  OpenFileCache& operator=(const OpenFileCache& other);
+};
+
+OpenFileCache& getOpenFileCache();
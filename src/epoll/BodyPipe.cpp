@@ -0,0 +1,142 @@
+#include "BodyPipe.hpp"
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <cerrno>
+#include "../exceptions/RequestError.hpp"
+#include "../responses/CgiResponse.hpp"
+#include "../utils/Utils.hpp"
+#include "EpollAction.hpp"
+#include "EpollData.hpp"
+
+BodyPipe::BodyPipe(CgiResponse* response)
+    : EpollFd(), read_end_(-1), finished_(false), response_(response)
+{
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) == -1)
+    throw RequestError(500, "Pipe creation failed");
+  read_end_ = fds[0];
+  fd_ = fds[1];
+  if (fcntl(fd_, F_SETFL, O_NONBLOCK) == -1)
+  {
+    Utils::ft_close(read_end_);
+    throw RequestError(500, "fcntl failed on write end of pipe");
+  }
+  ep_event_->events = 0;
+}
+
+BodyPipe::~BodyPipe()
+{
+  Utils::ft_close(read_end_);
+  if (response_)
+  {
+    response_->unsetBodyPipe();
+    response_->resumeReading();
+  }
+}
+
+/*
+ * Only polls for writing while there's something left to write, errors (the
+ * CGI closed its stdin) are reported anyway
+ */
+EpollAction BodyPipe::epollCallback(int event)
+{
+  EpollAction action = {fd_, EPOLL_ACTION_DEL, NULL};
+
+  if (!response_ || (event & EPOLLERR) || !flush())
+    return action;
+  if (pending_.empty() && finished_)
+    return action;
+  if (!pending_.empty())
+  {
+    action.op = EPOLL_ACTION_UNCHANGED;
+    return action;
+  }
+
+  ep_event_->events = 0;
+  if (!response_->resumeReading())
+    return action;
+  action.op = EPOLL_ACTION_MOD;
+  action.event = ep_event_;
+  return action;
+}
+
+int BodyPipe::getReadEnd() const
+{
+  return read_end_;
+}
+
+/*
+ * Called once the CGI got the read end as stdin
+ */
+void BodyPipe::start(void)
+{
+  Utils::ft_close(read_end_);
+
+  EpollData& ed = getEpollData();
+  if (epoll_ctl(ed.fd, EPOLL_CTL_ADD, fd_, ep_event_) == -1)
+    throw RequestError(500, "Unable to add FD of pipe to epoll");
+  ed.fds.insert(fd_, this);
+}
+
+/*
+ * Writes the next part of the body, `last` if it completes it. The client
+ * connection is paused if the pipe is full.
+ */
+void BodyPipe::write(const std::string& data, bool last)
+{
+  finished_ = last;
+  pending_.append(data);
+  if (!flush())
+  {
+    pending_.clear();
+    return;
+  }
+  if (pending_.empty() && !finished_)
+    return;
+
+  if (!pollForWriting())
+    throw RequestError(500, "Unable to modify epoll event of pipe");
+  if (!finished_)
+    response_->pauseReading();
+}
+
+/*
+ * The response is gone, so is the CGI, the pipe only waits to be removed
+ */
+void BodyPipe::unsetResponse(void)
+{
+  response_ = NULL;
+  pending_.clear();
+  pollForWriting();
+}
+
+/*
+ * Returns false if the CGI doesn't read its stdin anymore
+ */
+bool BodyPipe::flush(void)
+{
+  size_t written = 0;
+  while (written < pending_.size())
+  {
+    ssize_t ret =
+        ::write(fd_, pending_.data() + written, pending_.size() - written);
+    if (ret == -1)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      return false;
+    }
+    written += ret;
+  }
+  pending_.erase(0, written);
+  return true;
+}
+
+bool BodyPipe::pollForWriting(void)
+{
+  if (ep_event_->events == EPOLLOUT)
+    return true;
+  ep_event_->events = EPOLLOUT;
+  return epoll_ctl(getEpollData().fd, EPOLL_CTL_MOD, fd_, ep_event_) != -1;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include "EpollFd.hpp"
+
+class CgiResponse;
+
+/*
+ * Write end of the pipe a CGI gets as stdin when the request body is
+ * streamed to it (`cgi_request_buffering off`). The body is written as it
+ * comes in, whatever doesn't fit into the pipe is kept until it's writable
+ * again. In the meantime the client connection stops reading, so a script
+ * that reads slowly also slows down the upload instead of the body piling up
+ * here.
+ *
+ * Once the script closed its stdin (or exited) the rest of the body is
+ * dropped, the response is sent anyway.
+ */
+class BodyPipe : public EpollFd
+{
+ public:
+  BodyPipe(CgiResponse* response);
+  ~BodyPipe();
+
+  EpollAction epollCallback(int event);
+  int getReadEnd() const;
+  void start(void);
+  void write(const std::string& data, bool last);
+  void unsetResponse(void);
+
+ private:
+  int read_end_;  // Only open until the CGI got it as stdin
+  std::string pending_;
+  bool finished_;  // The body is complete, closed once it's written
+  CgiResponse* response_;
+
+  bool flush(void);
+  bool pollForWriting(void);
+
+  BodyPipe(const BodyPipe& other);
+  BodyPipe& operator=(const BodyPipe& other);
+};
@@ -5,11 +5,13 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <algorithm>
 #include <exception>
 #include <string>
 #include <vector>
 #include "../Configs/Configs.hpp"
 #include "../Logger/Logger.hpp"
+#include "../TimerQueue.hpp"
 #include "../exceptions/ConError.hpp"
 #include "../exceptions/RequestError.hpp"
 #include "../parsing/Parsing.hpp"
@@ -19,23 +21,42 @@
 #include "../responses/StaticResponse.hpp"
 #include "../utils/Utils.hpp"
 #include "EpollAction.hpp"
+#include "EpollData.hpp"
 
-Connection::Connection(const std::vector< Server >& servers)
+Connection::Connection(const VirtualHosts& servers)
     : request_(Request(-1, servers, client_ip_)),
       servers_(servers),
       readbuf_(new char[CHUNK_SIZE]),
+      closing_(false),
       polling_write_(false),
+      reading_paused_(false),
       request_timeout_ping_(Utils::getCurrentTime()),
       keepalive_last_ping_(0),
       send_receive_ping_(request_timeout_ping_),
+      prev_connection_(NULL),
+      next_connection_(NULL),
       max_body_size_(0),
       content_length_(0),
       total_written_bytes_(0),
       chunked_(false)  // Initialize chunked to false
-{}
+{
+  EpollData& ed = getEpollData();
+
+  next_connection_ = ed.connections;
+  if (next_connection_)
+    next_connection_->prev_connection_ = this;
+  ed.connections = this;
+}
 
 Connection::~Connection()
 {
+  if (prev_connection_)
+    prev_connection_->next_connection_ = next_connection_;
+  else
+    getEpollData().connections = next_connection_;
+  if (next_connection_)
+    next_connection_->prev_connection_ = prev_connection_;
+
   delete[] readbuf_;
 }
 
@@ -47,7 +68,14 @@ EpollAction Connection::epollCallback(int event)
   {
     try
     {
-      return handleRead();
+      if (!(event & EPOLLOUT) || !request_.streamingBody())
+        return handleRead();
+      // Both at once while the body is streamed to a CGI
+      EpollAction action = sendWhileStreaming();
+      if (!request_.streamingBody())
+        return action;
+      EpollAction read = handleRead();
+      return read.op == EPOLL_ACTION_UNCHANGED ? action : read;
     }
     catch (RequestError& e)
     {
@@ -60,7 +88,7 @@ EpollAction Connection::epollCallback(int event)
           throw RequestError(404, "No error page configured");
         }
         const Location& location =
-            Request::findMatchingLocationBlock(server.locations, it->second);
+            Request::findMatchingLocationBlock(server, it->second);
         if (!location.GET)
           throw RequestError(405, "Method not allowed for error page");
         if (location.root.empty())
@@ -99,14 +127,36 @@ EpollAction Connection::handleRead()
   else if (ret == 0)
     throw ConErr("Peer closed connection");
   buffer_.append(readbuf_, ret);
-  if (request_.getStatus() == READING_BODY)
-    return processFileUpload();
-  return processBuffer();
+  parseBuffer();
+  return pollForWriting();
 }
 
-EpollAction Connection::processFileUpload()
+/*
+ * Parses as many requests as the read buffer holds. As long as the response
+ * to the current request is completely buffered already, its output is moved
+ * to `queued_output_` and the next pipelined request is processed right away,
+ * so the responses go out together instead of one per event loop iteration.
+ */
+void Connection::parseBuffer()
+{
+  while (true)
+  {
+    if (request_.getStatus() < READING_BODY)
+      processHeaderLines();
+    if (request_.getStatus() == READING_BODY)
+      processFileUpload();
+    if (request_.getStatus() != SENDING_RESPONSE || closing_ ||
+        queued_output_.size() >= PIPELINE_MAX_QUEUED ||
+        !request_.takeOutput(queued_output_))
+      return;
+    finishRequest();
+    if (closing_)
+      return;
+  }
+}
+
+void Connection::processFileUpload()
 {
-  EpollAction action = {fd_, EPOLL_ACTION_UNCHANGED, NULL};
   std::string write_buffer;
   static size_t chunk_size;
   // ── ◼︎ Content Length Upload ───────────────────────
@@ -116,18 +166,12 @@ EpollAction Connection::processFileUpload()
       mode_ = ERROR_LENGTH;
     if (mode_ != ERROR_LENGTH)
     {
-      if (static_cast< long >(buffer_.size()) > content_length_)
-      {
-        write_buffer = std::string(buffer_, 0, content_length_);
-        buffer_ = std::string(buffer_, content_length_);
-        total_written_bytes_ += content_length_;
-      }
-      else
-      {
-        write_buffer = buffer_;
-        buffer_.clear();
-        total_written_bytes_ += write_buffer.size();
-      }
+      size_t amount = std::min(
+          buffer_.size(),
+          static_cast< size_t >(content_length_ - total_written_bytes_));
+      write_buffer.assign(buffer_.data(), amount);
+      buffer_.consume(amount);
+      total_written_bytes_ += amount;
       if (total_written_bytes_ > max_body_size_)
         mode_ = ERROR_LENGTH;  // Indicate an error
       else if (total_written_bytes_ == content_length_)
@@ -139,22 +183,23 @@ EpollAction Connection::processFileUpload()
   else
   {
     if (buffer_.empty())
-      return action;  // No data to process
+      return;  // No data to process
     while (1)
     {
-      size_t pos = buffer_.find("\n");
+      size_t pos = buffer_.find('\n');
       if (pos == std::string::npos && write_buffer.empty())
-        return action;  // Not enough data for a chunk
+        return;  // Not enough data for a chunk
       if (pos == std::string::npos)
         break;
       bool carriage_return = (pos != 0 && buffer_[pos - 1] == '\r');
-      std::string chunk_size_str(buffer_, 0, pos - carriage_return);
+      Parsing::Cursor chunk_size_str(buffer_.data(),
+                                     buffer_.data() + pos - carriage_return);
       try
       {
         if (mode_ == TRAILER)
         {
-          buffer_ = buffer_.substr(pos + 1);
-          if (chunk_size_str.empty())
+          buffer_.consume(pos + 1);
+          if (chunk_size_str.atEnd())
           {
             mode_ = END;
             break;
@@ -167,10 +212,7 @@ EpollAction Connection::processFileUpload()
         else if (mode_ == NORM)
         {
           chunk_size = Parsing::getChunkHeaderSize(chunk_size_str);
-          if (buffer_.size() > pos + 1)
-            buffer_ = std::string(buffer_, pos + 1);
-          else
-            buffer_.clear();
+          buffer_.consume(pos + 1);
           if (chunk_size == 0)
           {
             //       ○      Setup for the next request
@@ -197,19 +239,19 @@ EpollAction Connection::processFileUpload()
         //       ○      Check if chunk available
         if (buffer_.empty() || buffer_.size() == chunk_size ||
             (buffer_.size() == chunk_size + 1 && buffer_[chunk_size] == '\r'))
-          return action;
+          break;  // Wait for the rest, but keep the chunks read so far
         //       ○      Extract the chunk
         std::string::size_type amount = std::min(chunk_size, buffer_.size());
-        write_buffer.append(buffer_, 0, amount);
+        write_buffer.append(buffer_.data(), amount);
         chunk_size -= amount;
-        buffer_ = buffer_.substr(amount);
+        buffer_.consume(amount);
         total_written_bytes_ += amount;
 
         if (chunk_size == 0)
         {
           if (buffer_[0] == '\n')
           {
-            buffer_ = buffer_.substr(1);
+            buffer_.consume(1);
             mode_ = NORM;
           }
           else if (buffer_[0] != '\r')
@@ -218,7 +260,7 @@ EpollAction Connection::processFileUpload()
             throw RequestError(400, "Invalid chunk, expected newline after CR");
           else
           {
-            buffer_ = buffer_.substr(2);
+            buffer_.consume(2);
             mode_ = NORM;
           }
         }
@@ -234,20 +276,10 @@ EpollAction Connection::processFileUpload()
   }
   if (mode_ != TRAILER)
     request_.uploadBody(write_buffer, mode_);
-  if (!polling_write_ && request_.getStatus() == SENDING_RESPONSE)
-  {
-    ep_event_->events = EPOLLOUT | EPOLLRDHUP;
-    action.op = EPOLL_ACTION_MOD;
-    action.event = ep_event_;
-    polling_write_ = true;
-  }
-  return action;
 }
 
-EpollAction Connection::processBuffer()
+void Connection::processHeaderLines()
 {
-  EpollAction action = {fd_, EPOLL_ACTION_UNCHANGED, NULL};
-
   size_t pos = buffer_.find('\n');
   while (pos != std::string::npos)
   {
@@ -256,31 +288,19 @@ EpollAction Connection::processBuffer()
     {
       --realpos;
     }
-    std::string line(buffer_, 0, realpos);
-    if (buffer_.size() > pos + 1)
-    {
-      buffer_ = std::string(buffer_, pos + 1);
-    }
-    else
-    {
-      buffer_.clear();
-    }
-    request_.addHeaderLine(line);
+    const char* line = buffer_.data();
+    buffer_.consume(pos + 1);
+    request_.addHeaderLine(line, realpos);
     if (request_.getStatus() == READING_BODY)
     {
       mode_ = NORM;
       total_written_bytes_ = 0;
-      if (request_.isChunked())
-      {
-        chunked_ = true;
-      }
-      else
-      {
+      chunked_ = request_.isChunked();
+      if (!chunked_)
         content_length_ = request_.getContentLength();
-      }
       max_body_size_ = request_.getMaxBodySize();
       request_timeout_ping_ = 0;
-      return processFileUpload();
+      return;
     }
     if (request_.getStatus() == SENDING_RESPONSE)
     {
@@ -296,36 +316,69 @@ EpollAction Connection::processBuffer()
     else if (request_.getStatus() == READING_HEADERS)
       throw RequestError(400, "Header too long");
   }
+}
+
+void Connection::finishRequest()
+{
+  closing_ = request_.closingConnection();
+  Logger::log() << "- " << client_ip_ << " - \"" << request_.getStartLine()
+                << "\" - " << request_.getHost() << " - "
+                << request_.getResponseCode() << std::endl;
+  request_ = Request(fd_, servers_, client_ip_);
+  reading_paused_ = false;
+}
+
+EpollAction Connection::pollForWriting()
+{
+  EpollAction action = {fd_, EPOLL_ACTION_UNCHANGED, NULL};
 
-  if (!polling_write_ && request_.getStatus() == SENDING_RESPONSE)
+  if (!polling_write_ && request_.streamingBody() && queued_output_.empty())
+    return pollWhileStreaming();
+  if (!polling_write_ && (request_.getStatus() == SENDING_RESPONSE ||
+                          !queued_output_.empty()))
   {
     ep_event_->events = EPOLLOUT | EPOLLRDHUP;
     action.op = EPOLL_ACTION_MOD;
     action.event = ep_event_;
     polling_write_ = true;
   }
-
   return action;
 }
 
+/*
+ * The output of already finished (pipelined) requests always goes out first,
+ * it belongs to requests that came in before the current one.
+ */
 EpollAction Connection::handleWrite()
 {
-  bool closing = false;
-
-  request_.sendResponse();
+  EpollAction action = {fd_, EPOLL_ACTION_UNCHANGED, ep_event_};
 
-  if (request_.getStatus() == COMPLETED)
+  while (true)
   {
-    closing = request_.closingConnection();
-    Logger::log() << "- " << client_ip_ << " - \"" << request_.getStartLine()
-                  << "\" - " << request_.getHost() << " - "
-                  << request_.getResponseCode() << std::endl;
-    request_ = Request(fd_, servers_, client_ip_);
+    if (!queued_output_.flush(fd_))
+      return action;
+    if (closing_)
+    {
+      action.op = EPOLL_ACTION_DEL;
+      return action;
+    }
+    if (request_.streamingBody())
+      return sendWhileStreaming();
+    if (request_.getStatus() != SENDING_RESPONSE)
+      break;
+
+    request_.sendResponse();
+    if (request_.getStatus() != COMPLETED)
+      return action;
+    finishRequest();
+    if (closing_)
+    {
+      action.op = EPOLL_ACTION_DEL;
+      return action;
+    }
     try
     {
-      processBuffer();
-      if (request_.getStatus() == READING_BODY)
-        processFileUpload();
+      parseBuffer();
     }
     catch (RequestError& e)
     {
@@ -333,64 +386,148 @@ EpollAction Connection::handleWrite()
           new StaticResponse(fd_, e.getCode(), request_.closingConnection()));
     }
   }
-  EpollAction action = {fd_, EPOLL_ACTION_UNCHANGED, ep_event_};
-  if (closing)
+
+  ep_event_->events = EPOLLIN | EPOLLRDHUP;
+  action.op = EPOLL_ACTION_MOD;
+  polling_write_ = false;
+  if (request_.getStatus() == READING_START_LINE)
   {
-    action.op = EPOLL_ACTION_DEL;
+    keepalive_last_ping_ = Utils::getCurrentTime();
+    request_timeout_ping_ = 0;
   }
-  else if (request_.getStatus() != SENDING_RESPONSE)
+  else if (request_.getStatus() == READING_HEADERS)
   {
-    ep_event_->events = EPOLLIN | EPOLLRDHUP;
-    action.op = EPOLL_ACTION_MOD;
-    polling_write_ = false;
-    if (request_.getStatus() == READING_START_LINE)
-    {
-      keepalive_last_ping_ = Utils::getCurrentTime();
-      request_timeout_ping_ = 0;
-    }
-    else if (request_.getStatus() == READING_HEADERS)
-    {
-      keepalive_last_ping_ = 0;
-      request_timeout_ping_ = Utils::getCurrentTime();
-    }
+    keepalive_last_ping_ = 0;
+    request_timeout_ping_ = Utils::getCurrentTime();
   }
+  getTimerQueue().schedule(fd_, getDeadline(), CONNECTION_TIMER);
   return action;
 }
 
-std::pair< EpollAction, u_int64_t > Connection::ping()
+/*
+ * Sends what the CGI wrote so far while the body is still streamed to it
+ */
+EpollAction Connection::sendWhileStreaming()
 {
-  EpollAction action;
-  u_int64_t current_time;
-  u_int64_t time_diff = 0;
+  request_.sendResponse();
+  if (!request_.streamingBody())
+    return pollForWriting();  // The response got replaced by an error
+  return pollWhileStreaming();
+}
 
-  action.event = getEvent();
-  action.fd = fd_;
-  action.op = EPOLL_ACTION_UNCHANGED;
+/*
+ * While the body is streamed to a CGI, the connection reads it and sends the
+ * output of the CGI at the same time. Reading pauses while the CGI doesn't
+ * keep up with the body (see BodyPipe), writing while there's no output.
+ */
+EpollAction Connection::pollWhileStreaming()
+{
+  EpollAction action = {fd_, EPOLL_ACTION_UNCHANGED, NULL};
+  u_int32_t events = EPOLLRDHUP;
 
-  current_time = Utils::getCurrentTime();
-  if (keepalive_last_ping_ > 0)
-    time_diff = current_time - keepalive_last_ping_;
-  else if ((request_timeout_ping_ > 0 &&
-            current_time >= request_timeout_ping_ + REQUEST_TIMEOUT_SECONDS) ||
-           current_time >= send_receive_ping_ + SEND_RECEIVE_TIMEOUT)
+  if (!reading_paused_)
+    events |= EPOLLIN;
+  if (request_.hasOutput())
+    events |= EPOLLOUT;
+  polling_write_ = false;
+  if (events == ep_event_->events)
+    return action;
+  ep_event_->events = events;
+  action.op = EPOLL_ACTION_MOD;
+  action.event = ep_event_;
+  return action;
+}
+
+/*
+ * Stops reading the body until the CGI took what it got so far (see BodyPipe)
+ */
+void Connection::pauseReading()
+{
+  reading_paused_ = true;
+  if (!(ep_event_->events & EPOLLIN))
+    return;
+  ep_event_->events &= ~EPOLLIN;
+  if (epoll_ctl(getEpollData().fd, EPOLL_CTL_MOD, fd_, ep_event_) == -1)
+    throw ConErr("Failed to modify epoll event");
+}
+
+/*
+ * Called by the BodyPipe once it's empty again. Reading only resumes if the
+ * body is still being streamed, and not while the output of pipelined
+ * requests goes out first.
+ *
+ * Returns false if modifying the epoll event failed.
+ */
+bool Connection::resumeReading()
+{
+  reading_paused_ = false;
+  if (!request_.streamingBody() || polling_write_ ||
+      (ep_event_->events & EPOLLIN))
+    return true;
+  ep_event_->events |= EPOLLIN | EPOLLRDHUP;
+  return epoll_ctl(getEpollData().fd, EPOLL_CTL_MOD, fd_, ep_event_) != -1;
+}
+
+/*
+ * Called by the timer queue once the deadline returned by getDeadline() has
+ * been reached. Since the timers are rescheduled lazily, the deadline might
+ * have moved in the meantime, in that case nothing happens.
+ */
+EpollAction Connection::ping(u_int64_t current_time)
+{
+  EpollAction action = {fd_, EPOLL_ACTION_UNCHANGED, getEvent()};
+
+  if (current_time < getDeadline())
+    return action;
+
+  if (keepalive_last_ping_ == 0 && request_.getStatus() < SENDING_RESPONSE)
   {
-    if (request_.getStatus() < SENDING_RESPONSE)
-    {
-      request_.setResponse(new StaticResponse(fd_, 408, true));
-      action.event->events = EPOLLOUT | EPOLLRDHUP;
-      action.op = EPOLL_ACTION_MOD;
-      request_timeout_ping_ = 0;
-    }
-    else
-    {
-      action.op = EPOLL_ACTION_DEL;
-    }
+    request_.setResponse(new StaticResponse(fd_, 408, true));
+    action.event->events = EPOLLOUT | EPOLLRDHUP;
+    action.op = EPOLL_ACTION_MOD;
+    request_timeout_ping_ = 0;
+    send_receive_ping_ = current_time;
   }
+  else
+  {
+    action.op = EPOLL_ACTION_DEL;
+  }
+
+  return action;
+}
+
+/*
+ * Returns the point in time (in seconds) at which the connection times out in
+ * its current state
+ */
+u_int64_t Connection::getDeadline() const
+{
+  if (keepalive_last_ping_ > 0)
+    return keepalive_last_ping_ +
+           Configuration::getInstance().getKeepAliveTimeout();
 
-  return std::make_pair(action, time_diff);
+  u_int64_t deadline = send_receive_ping_ + SEND_RECEIVE_TIMEOUT;
+  if (request_timeout_ping_ > 0 &&
+      request_timeout_ping_ + REQUEST_TIMEOUT_SECONDS < deadline)
+    deadline = request_timeout_ping_ + REQUEST_TIMEOUT_SECONDS;
+  return deadline;
+}
+
+/*
+ * Returns since when the connection is idling in keep-alive state, 0 if it
+ * isn't
+ */
+u_int64_t Connection::getKeepAliveSince() const
+{
+  return keepalive_last_ping_;
 }
 
 Request& Connection::getRequest()
 {
   return request_;
 }
+
+Connection* Connection::getNextConnection() const
+{
+  return next_connection_;
+}
@@ -5,9 +5,12 @@
 #include <string>
 #include <vector>
 #include "../Configs/Configs.hpp"
+#include "../Configs/VirtualHosts.hpp"
 #include "../epoll/EpollAction.hpp"
 #include "../epoll/EpollFd.hpp"
 #include "../requests/Request.hpp"
+#include "../responses/OutputQueue.hpp"
+#include "../utils/ReadBuffer.hpp"
 
 #ifndef CHUNK_SIZE
 #  define CHUNK_SIZE 4096
@@ -15,28 +18,40 @@
 
 #define REQUEST_TIMEOUT_SECONDS 30
 #define SEND_RECEIVE_TIMEOUT 60
+#define PIPELINE_MAX_QUEUED 65536
 
 class Connection : public EpollFd
 {
  public:
-  Connection(const std::vector< Server >& servers);
+  Connection(const VirtualHosts& servers);
   virtual ~Connection() = 0;
   EpollAction epollCallback(int event);
-  std::pair< EpollAction, u_int64_t > ping();
+  EpollAction ping(u_int64_t current_time);
+  u_int64_t getDeadline() const;
+  u_int64_t getKeepAliveSince() const;
   Request& getRequest();
+  Connection* getNextConnection() const;
+  EpollAction pollForWriting();
+  void pauseReading();
+  bool resumeReading();
 
  protected:
   Request request_;
   std::string client_ip_;
 
  private:
-  const std::vector< Server >& servers_;
+  const VirtualHosts& servers_;
   char* readbuf_;
-  std::string buffer_;
+  Utils::ReadBuffer buffer_;
+  OutputQueue queued_output_;  // Finished responses of pipelined requests
+  bool closing_;
   bool polling_write_;
+  bool reading_paused_;  // The CGI the body is streamed to doesn't keep up
   size_t request_timeout_ping_;
   size_t keepalive_last_ping_;
   size_t send_receive_ping_;
+  Connection* prev_connection_;
+  Connection* next_connection_;
 
   // ── ◼︎ File Upload ───────────────────────
   long max_body_size_;
@@ -49,7 +64,11 @@ class Connection : public EpollFd
   Connection& operator=(const Connection& other);
 
   EpollAction handleRead();
-  EpollAction processBuffer();
-  EpollAction processFileUpload();
+  void parseBuffer();
+  void processHeaderLines();
+  void processFileUpload();
+  void finishRequest();
   EpollAction handleWrite();
+  EpollAction sendWhileStreaming();
+  EpollAction pollWhileStreaming();
 };
@@ -2,7 +2,8 @@
 #include "../exceptions/Fatal.hpp"
 #include "../utils/Utils.hpp"
 
-EpollData::EpollData() : fd(epoll_create(1024))
+EpollData::EpollData()
+    : fd(epoll_create(1024)), connections(NULL), fastcgi_connections(NULL)
 {
   if (fd == -1)
     throw Fatal("epoll_create failed");
@@ -16,12 +17,28 @@ EpollData::EpollData() : fd(epoll_create(1024))
 
 EpollData::~EpollData()
 {
-  typedef std::map< const int, EpollFd* >::iterator iter_type;
+  for (int i = 0; i < fds.getCapacity(); ++i)
+    delete fds.find(i);
 
-  for (iter_type it = fds.begin(); it != fds.end(); ++it)
-    delete it->second;
+  close(fd);
+}
 
+/*
+ * A forked worker would otherwise share the epoll instance with its parent,
+ * so it needs to get its own
+ */
+void EpollData::reopen()
+{
   close(fd);
+  fd = epoll_create(1024);
+  if (fd == -1)
+    throw Fatal("epoll_create failed");
+
+  if (Utils::addCloExecFlag(fd) == -1)
+  {
+    close(fd);
+    throw Fatal("Unable to set O_CLOEXEC to epoll fd");
+  }
 }
 
 EpollData& getEpollData()
@@ -2,18 +2,23 @@
 
 #include <sys/epoll.h>
 #include <unistd.h>
-#include <map>
 #include "EpollFd.hpp"
+#include "FdTable.hpp"
 
-typedef std::map< const int, EpollFd* > EpollMap;
+class Connection;
+class FastCgiConnection;
 
 struct EpollData
 {
   int fd;
-  EpollMap fds;
+  FdTable fds;
+  Connection* connections;  // Intrusive list of all live client connections
+  FastCgiConnection* fastcgi_connections;  // Same for FastCGI servers
 
   EpollData();
   ~EpollData();
+
+  void reopen();
 };
 
 EpollData& getEpollData();
@@ -0,0 +1,555 @@
+#include "FastCgiConnection.hpp"
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include "../TimerQueue.hpp"
+#include "../exceptions/ConError.hpp"
+#include "../exceptions/RequestError.hpp"
+#include "../responses/CgiResponse.hpp"
+#include "../utils/Utils.hpp"
+#include "EpollData.hpp"
+
+// Record types and flags of the FastCGI 1.0 specification
+#define FCGI_VERSION_1 1
+#define FCGI_BEGIN_REQUEST 1
+#define FCGI_ABORT_REQUEST 2
+#define FCGI_END_REQUEST 3
+#define FCGI_PARAMS 4
+#define FCGI_STDIN 5
+#define FCGI_STDOUT 6
+#define FCGI_STDERR 7
+#define FCGI_GET_VALUES 9
+#define FCGI_GET_VALUES_RESULT 10
+#define FCGI_RESPONDER 1
+#define FCGI_KEEP_CONN 1
+#define FCGI_REQUEST_COMPLETE 0
+#define FCGI_HEADER_LEN 8
+#define FCGI_CONTENT_MAX 65535
+
+// The request bodies are only read further while less than this is queued
+#define FASTCGI_OUTPUT_LOW 65536
+
+/*
+ * Lengths in name-value pairs take one byte below 128, otherwise four with
+ * the highest bit set
+ */
+static void appendLength(std::string& out, size_t length)
+{
+  if (length < 128)
+  {
+    out += static_cast< char >(length);
+    return;
+  }
+  out += static_cast< char >(((length >> 24) & 0x7f) | 0x80);
+  out += static_cast< char >((length >> 16) & 0xff);
+  out += static_cast< char >((length >> 8) & 0xff);
+  out += static_cast< char >(length & 0xff);
+}
+
+static void appendPair(std::string& out,
+                       const char* name,
+                       size_t name_length,
+                       const char* value,
+                       size_t value_length)
+{
+  appendLength(out, name_length);
+  appendLength(out, value_length);
+  out.append(name, name_length);
+  out.append(value, value_length);
+}
+
+static bool readLength(const unsigned char*& pos,
+                       const unsigned char* end,
+                       size_t& length)
+{
+  if (pos == end)
+    return false;
+  if (*pos < 128)
+  {
+    length = *pos++;
+    return true;
+  }
+  if (end - pos < 4)
+    return false;
+  length = (static_cast< size_t >(pos[0] & 0x7f) << 24) |
+           (static_cast< size_t >(pos[1]) << 16) |
+           (static_cast< size_t >(pos[2]) << 8) | pos[3];
+  pos += 4;
+  return true;
+}
+
+/*
+ * Returns a connection to `upstream` that can take another request, a new
+ * one if all of them are busy
+ */
+FastCgiConnection* FastCgiConnection::acquire(const FastCgiAddress& upstream)
+{
+  EpollData& ed = getEpollData();
+
+  for (FastCgiConnection* c = ed.fastcgi_connections; c;
+       c = c->next_connection_)
+  {
+    if (c->accepts(upstream.name))
+      return c;
+  }
+  return new FastCgiConnection(upstream);
+}
+
+/*
+ * Connects without blocking, the first thing sent is the question whether
+ * the server multiplexes. Until the answer arrives, requests are sent one at
+ * a time.
+ */
+FastCgiConnection::FastCgiConnection(const FastCgiAddress& upstream)
+    : EpollFd(),
+      name_(upstream.name),
+      keep_conn_(upstream.keep_conn),
+      connecting_(false),
+      multiplexing_(false),
+      polling_write_(true),
+      active_count_(0),
+      idle_since_(Utils::getCurrentTime()),
+      prev_connection_(NULL),
+      next_connection_(NULL)
+{
+  const struct sockaddr* address =
+      reinterpret_cast< const struct sockaddr* >(&upstream.address);
+
+  fd_ = socket(address->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+               0);
+  if (fd_ == -1)
+    throw RequestError(502, "Unable to create socket for FastCGI");
+  // Records are always queued completely, so there is nothing to gain from
+  // delaying small ones (e.g. an abort)
+  int nodelay = 1;
+  if (address->sa_family != AF_UNIX)
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  if (connect(fd_, address, upstream.length) == -1)
+  {
+    if (errno != EINPROGRESS)
+      throw RequestError(502, "Unable to connect to FastCGI server");
+    connecting_ = true;
+  }
+
+  if (keep_conn_)
+  {
+    std::string query;
+    appendPair(query, "FCGI_MPXS_CONNS", 15, "", 0);
+    queueRecord(FCGI_GET_VALUES, 0, query.data(), query.size());
+  }
+
+  EpollData& ed = getEpollData();
+  ep_event_->events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+  if (epoll_ctl(ed.fd, EPOLL_CTL_ADD, fd_, ep_event_) == -1)
+    throw RequestError(502, "Unable to add FastCGI connection to epoll");
+  ed.fds.insert(fd_, this);
+  getTimerQueue().schedule(fd_, idle_since_ + FASTCGI_IDLE_TIMEOUT,
+                           FASTCGI_TIMER);
+
+  next_connection_ = ed.fastcgi_connections;
+  if (next_connection_)
+    next_connection_->prev_connection_ = this;
+  ed.fastcgi_connections = this;
+}
+
+/*
+ * Whatever the responses of the unfinished requests got so far is all they
+ * get
+ */
+FastCgiConnection::~FastCgiConnection()
+{
+  for (size_t i = 0; i < requests_.size(); ++i)
+  {
+    FastCgiRequest& request = requests_[i];
+    if (!request.active)
+      continue;
+    Utils::ft_close(request.input);
+    if (request.response)
+    {
+      request.response->setCloseConnectionHeader();
+      request.response->unsetFastCgi(false);
+      request.response->resumeSending();
+    }
+  }
+
+  if (prev_connection_)
+    prev_connection_->next_connection_ = next_connection_;
+  else
+    getEpollData().fastcgi_connections = next_connection_;
+  if (next_connection_)
+    next_connection_->prev_connection_ = prev_connection_;
+}
+
+bool FastCgiConnection::accepts(const std::string& name) const
+{
+  size_t limit = multiplexing_ ? FASTCGI_MAX_REQUESTS : 1;
+
+  return keep_conn_ && active_count_ < limit && name == name_;
+}
+
+EpollAction FastCgiConnection::epollCallback(int event)
+{
+  EpollAction action = {fd_, EPOLL_ACTION_UNCHANGED, NULL};
+
+  try
+  {
+    if (event & (EPOLLOUT | EPOLLERR))
+      handleWrite();
+    if (event & (EPOLLIN | EPOLLHUP | EPOLLRDHUP))
+      handleRead();
+    if (!updateEvents())
+      throw ConErr("Unable to modify epoll event of FastCGI connection");
+  }
+  catch (ConErr& e)
+  {
+    if (active_count_ > 0)
+      std::cerr << "FastCGI " << name_ << ": " << e.what() << std::endl;
+    action.op = EPOLL_ACTION_DEL;
+  }
+  return action;
+}
+
+/*
+ * Queues the records that start request `response` and returns its id.
+ * `params` are the CGI meta variables ("NAME=value"), the body is sent from
+ * `input_file` if there is one.
+ */
+u_int16_t FastCgiConnection::beginRequest(
+    CgiResponse* response,
+    const std::vector< std::string >& params,
+    const std::string& input_file)
+{
+  char begin[] = {0, FCGI_RESPONDER, 0, 0, 0, 0, 0, 0};
+  if (keep_conn_)
+    begin[2] = FCGI_KEEP_CONN;
+
+  int input = -1;
+  if (!input_file.empty())
+  {
+    input = open(input_file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (input == -1)
+      throw RequestError(500, "Unable to open request body for FastCGI");
+  }
+
+  size_t index = 0;
+  while (index < requests_.size() && requests_[index].active)
+    ++index;
+  if (index == requests_.size())
+    requests_.push_back(FastCgiRequest());
+  FastCgiRequest& request = requests_[index];
+  request.active = true;
+  request.response = response;
+  request.input = input;
+  request.start_time = Utils::getCurrentTime();
+  ++active_count_;
+  u_int16_t id = static_cast< u_int16_t >(index + 1);
+
+  std::string encoded;
+  for (size_t i = 0; i < params.size(); ++i)
+  {
+    std::string::size_type pos = params[i].find('=');
+    appendPair(encoded, params[i].data(), pos, params[i].data() + pos + 1,
+               params[i].size() - pos - 1);
+  }
+  queueRecord(FCGI_BEGIN_REQUEST, id, begin, sizeof(begin));
+  for (size_t pos = 0; pos < encoded.size(); pos += FCGI_CONTENT_MAX)
+    queueRecord(FCGI_PARAMS, id, encoded.data() + pos,
+                std::min(encoded.size() - pos,
+                         static_cast< size_t >(FCGI_CONTENT_MAX)));
+  queueRecord(FCGI_PARAMS, id, NULL, 0);
+  if (input == -1)
+    queueRecord(FCGI_STDIN, id, NULL, 0);
+
+  if (!updateEvents())
+  {
+    releaseRequest(request);
+    throw RequestError(502, "Unable to poll FastCGI connection");
+  }
+  getTimerQueue().schedule(
+      fd_, request.start_time + Configuration::getInstance().getCgiTimeout(),
+      FASTCGI_TIMER);
+  return id;
+}
+
+/*
+ * The response of request `id` is gone. Its id stays taken until the server
+ * confirms the abort with FCGI_END_REQUEST, everything it still sends for it
+ * gets dropped.
+ */
+void FastCgiConnection::abortRequest(u_int16_t id)
+{
+  FastCgiRequest& request = requests_[id - 1];
+
+  request.response = NULL;
+  request.start_time = Utils::getCurrentTime();
+  Utils::ft_close(request.input);
+  queueRecord(FCGI_ABORT_REQUEST, id, NULL, 0);
+  updateEvents();
+}
+
+/*
+ * Aborts the requests that ran longer than the CGI timeout and hands their
+ * responses to `expired`.
+ *
+ * Returns false if the connection should be closed: it has been unused for
+ * FASTCGI_IDLE_TIMEOUT, or the server didn't even end an aborted request in
+ * time.
+ */
+bool FastCgiConnection::expire(u_int64_t current_time,
+                               std::vector< CgiResponse* >& expired)
+{
+  u_int64_t timeout = Configuration::getInstance().getCgiTimeout();
+
+  for (size_t i = 0; i < requests_.size(); ++i)
+  {
+    FastCgiRequest& request = requests_[i];
+    if (!request.active || request.start_time + timeout > current_time)
+      continue;
+    if (!request.response)
+      return false;
+    CgiResponse* response = request.response;
+    response->unsetFastCgi(false);
+    response->resumeSending();
+    abortRequest(static_cast< u_int16_t >(i + 1));
+    expired.push_back(response);
+  }
+  return active_count_ > 0 ||
+         idle_since_ + FASTCGI_IDLE_TIMEOUT > current_time;
+}
+
+/*
+ * Returns the point in time (in seconds) at which the next request times out
+ * or, if there is none, the connection has been idle for too long
+ */
+u_int64_t FastCgiConnection::getDeadline() const
+{
+  if (active_count_ == 0)
+    return idle_since_ + FASTCGI_IDLE_TIMEOUT;
+
+  u_int64_t timeout = Configuration::getInstance().getCgiTimeout();
+  u_int64_t deadline = 0;
+  for (size_t i = 0; i < requests_.size(); ++i)
+  {
+    if (requests_[i].active &&
+        (deadline == 0 || requests_[i].start_time + timeout < deadline))
+      deadline = requests_[i].start_time + timeout;
+  }
+  return deadline;
+}
+
+void FastCgiConnection::handleRead()
+{
+  ssize_t ret = read(fd_, read_buffer_, FASTCGI_READ_SIZE);
+
+  if (ret == -1)
+  {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return;
+    throw ConErr("Read from FastCGI server failed");
+  }
+  if (ret == 0)
+    throw ConErr("FastCGI server closed the connection");
+  input_.append(read_buffer_, ret);
+  processRecords();
+}
+
+/*
+ * Once the socket is connected, the bodies of the requests get read on as
+ * long as the socket takes everything
+ */
+void FastCgiConnection::handleWrite()
+{
+  if (connecting_)
+  {
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &length) == -1 ||
+        error != 0)
+      throw ConErr("Unable to connect to FastCGI server");
+    connecting_ = false;
+  }
+
+  while (true)
+  {
+    queueInput();
+    if (output_.empty() || !output_.flush(fd_))
+      return;
+  }
+}
+
+void FastCgiConnection::processRecords()
+{
+  while (input_.size() >= FCGI_HEADER_LEN)
+  {
+    const unsigned char* header =
+        reinterpret_cast< const unsigned char* >(input_.data());
+    if (header[0] != FCGI_VERSION_1)
+      throw ConErr("Invalid record from FastCGI server");
+    u_int16_t id = static_cast< u_int16_t >((header[2] << 8) | header[3]);
+    u_int16_t length = static_cast< u_int16_t >((header[4] << 8) | header[5]);
+    size_t total = FCGI_HEADER_LEN + length + header[6];
+    if (input_.size() < total)
+      return;
+    processRecord(header[1], id, input_.data() + FCGI_HEADER_LEN, length);
+    input_.consume(total);
+  }
+}
+
+/*
+ * Records for unknown or already released ids are ignored
+ */
+void FastCgiConnection::processRecord(u_int8_t type,
+                                      u_int16_t id,
+                                      const char* content,
+                                      u_int16_t length)
+{
+  if (id == 0)
+  {
+    if (type == FCGI_GET_VALUES_RESULT)
+      processValues(content, length);
+    return;
+  }
+  if (id > requests_.size() || !requests_[id - 1].active)
+    return;
+
+  CgiResponse* response = requests_[id - 1].response;
+  if (type == FCGI_STDOUT && response && length > 0)
+  {
+    response->appendOutput(content, length);
+    response->resumeSending();
+  }
+  else if (type == FCGI_STDERR)
+    std::cerr.write(content, length);
+  else if (type == FCGI_END_REQUEST)
+    endRequest(id, content, length);
+}
+
+void FastCgiConnection::processValues(const char* content, u_int16_t length)
+{
+  const unsigned char* pos = reinterpret_cast< const unsigned char* >(content);
+  const unsigned char* end = pos + length;
+  size_t name_length;
+  size_t value_length;
+
+  while (readLength(pos, end, name_length) &&
+         readLength(pos, end, value_length) &&
+         static_cast< size_t >(end - pos) >= name_length + value_length)
+  {
+    std::string name(reinterpret_cast< const char* >(pos), name_length);
+    std::string value(reinterpret_cast< const char* >(pos) + name_length,
+                      value_length);
+    if (name == "FCGI_MPXS_CONNS")
+      multiplexing_ = (value == "1");
+    pos += name_length + value_length;
+  }
+}
+
+/*
+ * A non-zero exit status or a request the server refused (overloaded, can't
+ * multiplex) closes the client connection, just like a failing CGI process
+ */
+void FastCgiConnection::endRequest(u_int16_t id,
+                                   const char* content,
+                                   u_int16_t length)
+{
+  FastCgiRequest& request = requests_[id - 1];
+
+  if (request.response)
+  {
+    const unsigned char* body =
+        reinterpret_cast< const unsigned char* >(content);
+    if (length < 8 || body[0] != 0 || body[1] != 0 || body[2] != 0 ||
+        body[3] != 0 || body[4] != FCGI_REQUEST_COMPLETE)
+      request.response->setCloseConnectionHeader();
+    request.response->unsetFastCgi(true);
+    request.response->resumeSending();
+  }
+  releaseRequest(request);
+}
+
+/*
+ * Records are queued as one segment each, header and content together
+ */
+void FastCgiConnection::queueRecord(u_int8_t type,
+                                    u_int16_t id,
+                                    const char* content,
+                                    size_t length)
+{
+  char header[FCGI_HEADER_LEN] = {FCGI_VERSION_1,
+                                  static_cast< char >(type),
+                                  static_cast< char >(id >> 8),
+                                  static_cast< char >(id & 0xff),
+                                  static_cast< char >(length >> 8),
+                                  static_cast< char >(length & 0xff),
+                                  0,
+                                  0};
+  std::string record(header, FCGI_HEADER_LEN);
+
+  if (length > 0)
+    record.append(content, length);
+  output_.take(record);
+}
+
+/*
+ * Reads the next pieces of the request bodies, an empty FCGI_STDIN record
+ * marks the end of a body
+ */
+void FastCgiConnection::queueInput(void)
+{
+  for (size_t i = 0; i < requests_.size(); ++i)
+  {
+    FastCgiRequest& request = requests_[i];
+    u_int16_t id = static_cast< u_int16_t >(i + 1);
+    while (request.active && request.input != -1 &&
+           output_.size() < FASTCGI_OUTPUT_LOW)
+    {
+      ssize_t ret = read(request.input, read_buffer_, FASTCGI_READ_SIZE);
+      if (ret > 0)
+      {
+        queueRecord(FCGI_STDIN, id, read_buffer_, ret);
+        continue;
+      }
+      Utils::ft_close(request.input);
+      queueRecord(FCGI_STDIN, id, NULL, 0);
+    }
+  }
+}
+
+void FastCgiConnection::releaseRequest(FastCgiRequest& request)
+{
+  Utils::ft_close(request.input);
+  request.active = false;
+  request.response = NULL;
+  if (--active_count_ == 0)
+  {
+    idle_since_ = Utils::getCurrentTime();
+    getTimerQueue().schedule(fd_, idle_since_ + FASTCGI_IDLE_TIMEOUT,
+                             FASTCGI_TIMER);
+  }
+}
+
+/*
+ * Polls for writing while there is something to send, including bodies that
+ * haven't been read completely yet. Returns false if epoll_ctl failed.
+ */
+bool FastCgiConnection::updateEvents(void)
+{
+  bool writing = connecting_ || !output_.empty();
+
+  for (size_t i = 0; i < requests_.size() && !writing; ++i)
+    writing = requests_[i].active && requests_[i].input != -1;
+  if (writing == polling_write_)
+    return true;
+
+  polling_write_ = writing;
+  ep_event_->events = EPOLLIN | EPOLLRDHUP;
+  if (writing)
+    ep_event_->events |= EPOLLOUT;
+  return epoll_ctl(getEpollData().fd, EPOLL_CTL_MOD, fd_, ep_event_) != -1;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include "../Configs/Configs.hpp"
+#include "../responses/OutputQueue.hpp"
+#include "../utils/ReadBuffer.hpp"
+#include "EpollAction.hpp"
+#include "EpollFd.hpp"
+
+#define FASTCGI_READ_SIZE 16384
+#define FASTCGI_IDLE_TIMEOUT 60  // Seconds an unused connection is kept open
+#define FASTCGI_MAX_REQUESTS 16  // Per connection, if the server multiplexes
+
+class CgiResponse;
+
+/*
+ * One request on a FastCGI connection. `response` is NULL once the request
+ * got aborted, the id stays taken until the server ends the request.
+ */
+struct FastCgiRequest
+{
+  bool active;
+  CgiResponse* response;
+  int input;  // Request body that still has to go out as FCGI_STDIN
+  u_int64_t start_time;
+};
+
+/*
+ * Persistent connection to a FastCGI server (`fastcgi_pass`), used instead of
+ * forking an interpreter per request.
+ *
+ * Connections are kept open (FCGI_KEEP_CONN) and reused for the following
+ * requests to the same server. A server that announces FCGI_MPXS_CONNS gets
+ * up to FASTCGI_MAX_REQUESTS requests over one connection at the same time,
+ * others one at a time, more connections are opened as needed. All live
+ * connections are in an intrusive list in EpollData. Connections to servers
+ * without `keep_conn` carry a single request.
+ *
+ * Request bodies are read from the upload file in pieces whenever the socket
+ * took the previous ones, so a large upload never sits in memory as a whole.
+ */
+class FastCgiConnection : public EpollFd
+{
+ public:
+  static FastCgiConnection* acquire(const FastCgiAddress& upstream);
+  ~FastCgiConnection();
+
+  EpollAction epollCallback(int event);
+  u_int16_t beginRequest(CgiResponse* response,
+                         const std::vector< std::string >& params,
+                         const std::string& input_file);
+  void abortRequest(u_int16_t id);
+  bool expire(u_int64_t current_time, std::vector< CgiResponse* >& expired);
+  u_int64_t getDeadline() const;
+
+ private:
+  std::string name_;
+  bool keep_conn_;
+  bool connecting_;
+  bool multiplexing_;
+  bool polling_write_;
+  size_t active_count_;
+  u_int64_t idle_since_;
+  std::vector< FastCgiRequest > requests_;  // Request id - 1 as index
+  OutputQueue output_;
+  Utils::ReadBuffer input_;
+  char read_buffer_[FASTCGI_READ_SIZE];
+  FastCgiConnection* prev_connection_;
+  FastCgiConnection* next_connection_;
+
+  explicit FastCgiConnection(const FastCgiAddress& upstream);
+
+  bool accepts(const std::string& name) const;
+  void handleRead();
+  void handleWrite();
+  void processRecords();
+  void processRecord(u_int8_t type,
+                     u_int16_t id,
+                     const char* content,
+                     u_int16_t length);
+  void processValues(const char* content, u_int16_t length);
+  void endRequest(u_int16_t id, const char* content, u_int16_t length);
+  void queueRecord(u_int8_t type,
+                   u_int16_t id,
+                   const char* content,
+                   size_t length);
+  void queueInput(void);
+  void releaseRequest(FastCgiRequest& request);
+  bool updateEvents(void);
+
+  FastCgiConnection(const FastCgiConnection& other);
+  FastCgiConnection& operator=(const FastCgiConnection& other);
+};
@@ -0,0 +1,30 @@
+#include "FdTable.hpp"
+
+FdTable::FdTable() {}
+
+FdTable::~FdTable() {}
+
+EpollFd* FdTable::find(int fd) const
+{
+  if (fd < 0 || static_cast< size_t >(fd) >= table_.size())
+    return NULL;
+  return table_[fd];
+}
+
+void FdTable::insert(int fd, EpollFd* epoll_fd)
+{
+  if (static_cast< size_t >(fd) >= table_.size())
+    table_.resize(fd + 1, NULL);
+  table_[fd] = epoll_fd;
+}
+
+void FdTable::erase(int fd)
+{
+  if (fd >= 0 && static_cast< size_t >(fd) < table_.size())
+    table_[fd] = NULL;
+}
+
+int FdTable::getCapacity() const
+{
+  return static_cast< int >(table_.size());
+}
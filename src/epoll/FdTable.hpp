@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "EpollFd.hpp"
+
+/*
+ * Lookup table from fd to its EpollFd object. Fds are small and dense
+ * integers, so they can be used as index directly instead of going through a
+ * tree. Slots of fds that aren't registered are NULL.
+ */
+class FdTable
+{
+ public:
+  FdTable();
+  ~FdTable();
+
+  EpollFd* find(int fd) const;
+  void insert(int fd, EpollFd* epoll_fd);
+  void erase(int fd);
+  int getCapacity() const;
+
+ private:
+  std::vector< EpollFd* > table_;
+
+  FdTable(const FdTable& other);
+  FdTable& operator=(const FdTable& other);
+};
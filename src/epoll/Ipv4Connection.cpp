@@ -7,7 +7,7 @@
 #include "../exceptions/FdLimitReached.hpp"
 #include "../utils/Utils.hpp"
 Ipv4Connection::Ipv4Connection(int socket_fd,
-                               const std::vector< Server >& servers)
+                               const VirtualHosts& servers)
     : Connection(servers)
 {
   struct sockaddr_in peer_addr;
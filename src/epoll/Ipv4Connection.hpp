@@ -5,6 +5,6 @@
 class Ipv4Connection : public Connection
 {
  public:
-  Ipv4Connection(int socket_fd, const std::vector< Server >& servers);
+  Ipv4Connection(int socket_fd, const VirtualHosts& servers);
   ~Ipv4Connection();
 };
@@ -8,7 +8,7 @@
 #include "utils/Utils.hpp"
 
 Ipv6Connection::Ipv6Connection(int socket_fd,
-                               const std::vector< Server >& servers)
+                               const VirtualHosts& servers)
     : Connection(servers)
 {
   struct sockaddr_in6 peer_addr;
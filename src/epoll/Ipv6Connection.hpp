@@ -5,6 +5,6 @@
 class Ipv6Connection : public Connection
 {
  public:
-  Ipv6Connection(int socket_fd, const std::vector< Server >& servers);
+  Ipv6Connection(int socket_fd, const VirtualHosts& servers);
   ~Ipv6Connection();
 };
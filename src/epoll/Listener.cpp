@@ -8,6 +8,7 @@
 #include <iostream>
 #include "../exceptions/ConError.hpp"
 #include "../exceptions/Fatal.hpp"
+#include "../TimerQueue.hpp"
 #include "../ip/IpAddress.hpp"
 #include "../utils/Utils.hpp"
 #include "Connection.hpp"
@@ -39,7 +40,8 @@ Listener::~Listener() {}
 
 void Listener::setup()
 {
-  fd_ = address_->createSocket();
+  fd_ = address_->createSocket(
+      Configuration::getInstance().getWorkerProcesses() > 1);
 }
 
 struct epoll_event* Listener::getEpollEvent()
@@ -54,7 +56,7 @@ bool Listener::operator==(const Listener& other) const
 
 void Listener::addServer(const Server& server)
 {
-  servers_.push_back(server);
+  servers_.add(server);
 }
 
 EpollAction Listener::epollCallback(int event)
@@ -82,6 +84,7 @@ EpollAction Listener::acceptConnection()
       delete c;
       throw ConErr("Unable to set O_CLOEXEC on accepted client connection");
     }
+    getTimerQueue().schedule(c->getFd(), c->getDeadline(), CONNECTION_TIMER);
     EpollAction action = {c->getFd(), EPOLL_ACTION_ADD, c->getEvent()};
     return action;
   }
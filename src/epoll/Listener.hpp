@@ -4,6 +4,7 @@
 #include <sys/types.h>
 #include <vector>
 #include "../Configs/Configs.hpp"
+#include "../Configs/VirtualHosts.hpp"
 #include "../ip/IpAddress.hpp"
 #include "EpollAction.hpp"
 #include "EpollFd.hpp"
@@ -27,5 +28,5 @@ class Listener : public EpollFd
   Listener& operator=(const Listener& other);
 
   const IpAddress* address_;
-  std::vector< Server > servers_;
+  VirtualHosts servers_;
 };
@@ -6,39 +6,41 @@
 #include <unistd.h>
 #include <cstddef>
 #include <iostream>
-#include <sstream>
 #include "../Configs/Configs.hpp"
 #include "../Logger/Logger.hpp"
 #include "../PidTracker.hpp"
-#include "../exceptions/ExitExc.hpp"
+#include "../TimerQueue.hpp"
+#include "../exceptions/ConError.hpp"
 #include "../exceptions/RequestError.hpp"
 #include "../requests/RequestMethods.hpp"
 #include "../responses/CgiResponse.hpp"
+#include "../utils/Spawn.hpp"
 #include "../utils/Utils.hpp"
 #include "EpollAction.hpp"
 #include "EpollData.hpp"
-PipeFd::PipeFd(std::string& write_buffer,
-               const std::string& skript_path,
+PipeFd::PipeFd(const std::string& skript_path,
                const std::string& cgi_path,
                const std::string& file_path,
+               int input_fd,
                Response* cgi_response,
                char** envp,
                RequestMethod method)
     : EpollFd(),
       read_end_(-1),
       write_end_(-1),
+      process_id_(-1),
       process_finished_(false),
-      write_buffer_(write_buffer),
       bin_path_(cgi_path),
       skript_path_(skript_path),
       file_path_(file_path),
+      input_fd_(input_fd),
       cgi_response_(cgi_response),
       start_time_(Utils::getCurrentTime()),
-      method_(method),
-      stdin_(STDIN_FILENO)
+      paused_since_(0),
+      method_(method)
 {
   int fds[2];
-  if (pipe(fds) == -1)
+  if (pipe2(fds, O_CLOEXEC) == -1)
   {
     throw RequestError(500, "Pipe creation failed");
   }
@@ -50,66 +52,25 @@ PipeFd::PipeFd(std::string& write_buffer,
     throw(RequestError(500, "fcntl failed on read end of pipe"));
   }
 
-  process_id_ = fork();
+  process_id_ = spawnCGI(envp);
+  Utils::ft_close(write_end_);
   if (process_id_ == -1)
   {
     closePipe();
-    throw(RequestError(500, "Fork failed"));
-  }
-  else if (process_id_ == 0)
-  {
-    Utils::ft_close(fds[0]);
-    Logger::close();  // Needs to be closed manually because we can't set
-                      // O_CLOEXEC on ofstreams...
-    Configuration& config = Configuration::getInstance();
-    const LogSettings& error_settings = config.getErrorLogsettings();
-    if (error_settings.configured)
-    {
-      if (error_settings.mode == LOGFILE)
-      {
-        int fd = open(error_settings.logfile.c_str(),
-                      O_CREAT | O_WRONLY | O_APPEND, 0644);
-        if (fd == -1)
-          std::cerr << "WARNING: Unable to open logfile for error log"
-                    << std::endl;
-        else
-        {
-          dup2(fd, STDERR_FILENO);
-          close(fd);
-        }
-      }
-    }
-    else
-    {
-      close(STDERR_FILENO);
-    }
-    spawnCGI(envp);
-    /*
-     * Close stdin/stdout in child after execve failure, because they're fds
-     * associated with files now. Use ft_close for stdin because it could
-     * already be closed (when there is no request body)
-     */
-    Utils::ft_close(stdin_);
-    close(STDOUT_FILENO);
-    if (!error_settings.configured)
-      close(STDERR_FILENO);
-    throw ExitExc();
+    throw(RequestError(500, "Unable to start CGI process"));
   }
-  else
-  {
-    Utils::ft_close(fds[1]);
-
-    EpollData& ed = getEpollData();
 
-    if (Utils::addCloExecFlag(fds[0]) == -1 ||
-        epoll_ctl(ed.fd, EPOLL_CTL_ADD, read_end_, getEvent()) == -1)
-    {
-      Utils::ft_close(fds[0]);
-      killProcess();
-      throw RequestError(500, "Unable to add FD of pipe to epoll");
-    }
-    ed.fds[read_end_] = this;
+  EpollData& ed = getEpollData();
+  if (epoll_ctl(ed.fd, EPOLL_CTL_ADD, read_end_, getEvent()) == -1)
+  {
+    closePipe();
+    killProcess();
+    throw RequestError(500, "Unable to add FD of pipe to epoll");
   }
+  ed.fds.insert(read_end_, this);
+  getTimerQueue().schedule(
+      read_end_, start_time_ + Configuration::getInstance().getCgiTimeout(),
+      CGI_TIMER);
   fd_ = read_end_;
 }
 
@@ -131,50 +92,30 @@ void PipeFd::closePipe()
   Utils::ft_close(write_end_);
 }
 
-void PipeFd::spawnCGI(char** envp)
+/*
+ * The script runs in its own directory, with the request body (if any) as
+ * stdin (the upload file or a BodyPipe it's streamed to) and the pipe as
+ * stdout. Returns the pid, -1 if it couldn't be started.
+ */
+pid_t PipeFd::spawnCGI(char** envp)
 {
   char* argv[3];
   argv[0] = const_cast< char* >(bin_path_.c_str());
   argv[1] = const_cast< char* >(skript_path_.c_str());
   argv[2] = NULL;
 
-  std::cout.clear();
-  std::string directory =
-      skript_path_.substr(0, skript_path_.find_last_of('/') + 1);
-  if (chdir(directory.c_str()) == -1)
-  {
-    Utils::ft_close(write_end_);
-    throw(RequestError(500, "chdir failed in CGI process"));
-  }
-  int file_fd = -1;
-  if (!file_path_.empty() && method_ == POST)
-  {
-    file_fd = open(file_path_.c_str(), O_RDONLY);
-    if (file_fd == -1)
-    {
-      Utils::ft_close(write_end_);
-      throw(ExitExc());
-    }
-    if (dup2(file_fd, STDIN_FILENO) == -1)
-    {
-      Utils::ft_close(file_fd);
-      Utils::ft_close(write_end_);
-      throw(ExitExc());
-    }
-    Utils::ft_close(file_fd);
-  }
+  Utils::Spawn spawn;
+  spawn.chdir(skript_path_.substr(0, skript_path_.find_last_of('/') + 1));
+  if (input_fd_ != -1)
+    spawn.dup2(input_fd_, STDIN_FILENO);
+  else if (!file_path_.empty() && method_ == POST)
+    spawn.open(STDIN_FILENO, file_path_, O_RDONLY, 0);
   else
-    Utils::ft_close(stdin_);
-
-  if (dup2(write_end_, STDOUT_FILENO) == -1)
-  {
-    Utils::ft_close(stdin_);
-    Utils::ft_close(write_end_);
-    throw(ExitExc());
-  }
-  Utils::ft_close(write_end_);
+    spawn.close(STDIN_FILENO);
+  spawn.dup2(write_end_, STDOUT_FILENO);
+  Logger::setupChildStderr(spawn);
 
-  execve(bin_path_.c_str(), argv, envp);
+  return spawn.run(bin_path_, argv, envp);
 }
 
 EpollAction PipeFd::epollCallback(int event)
@@ -188,6 +129,8 @@ EpollAction PipeFd::epollCallback(int event)
     killProcess();
     process_finished_ = true;
   }
+  else if (paused_since_ > 0)
+    return action;  // A hangup, the rest is read once the output resumes
   else if (event & EPOLLIN)
   {
     ssize_t bytes_read_ = read(read_end_, read_buffer_, CHUNK_SIZE);
@@ -200,21 +143,10 @@ EpollAction PipeFd::epollCallback(int event)
     else
     {
       if (bytes_read_ > 0)
-      {
-        if (response->getHeadersCreated())
-        {
-          std::ostringstream ss;
-          ss << std::hex << bytes_read_ << "\r\n";
-          write_buffer_.append(ss.str());
-          write_buffer_.append(read_buffer_, bytes_read_);
-          write_buffer_.append("\r\n");
-        }
-        else
-        {
-          write_buffer_.append(read_buffer_, bytes_read_);
-        }
-      }
+        response->appendOutput(read_buffer_, bytes_read_);
       checkExited(response);
+      if (response->outputFull())
+        action = pauseReading();
     }
   }
   else if (event & EPOLLHUP)
@@ -233,10 +165,50 @@ EpollAction PipeFd::epollCallback(int event)
   return action;
 }
 
+/*
+ * A paused pipe has to be polled again, otherwise a hangup that was already
+ * reported wouldn't be seen a second time and it would never get removed
+ */
 void PipeFd::unsetResponse(void)
 {
   cgi_response_ = NULL;
   killProcess();
+  if (paused_since_ > 0)
+  {
+    start_time_ += Utils::getCurrentTime() - paused_since_;
+    paused_since_ = 0;
+    ep_event_->events = EPOLLIN | EPOLLRDHUP;
+    epoll_ctl(getEpollData().fd, EPOLL_CTL_MOD, fd_, ep_event_);
+  }
+}
+
+/*
+ * Stops reading the output of the script while the client is too slow to
+ * take it, it blocks once the pipe is full. Edge triggered with no events, a
+ * hangup is only reported once instead of over and over until it's resumed.
+ */
+EpollAction PipeFd::pauseReading(void)
+{
+  EpollAction action = {fd_, EPOLL_ACTION_MOD, ep_event_};
+
+  paused_since_ = Utils::getCurrentTime();
+  ep_event_->events = EPOLLET;
+  return action;
+}
+
+/*
+ * Called by the response once the client took enough of the output
+ */
+void PipeFd::resumeReading(void)
+{
+  if (paused_since_ == 0)
+    return;
+
+  start_time_ += Utils::getCurrentTime() - paused_since_;
+  paused_since_ = 0;
+  ep_event_->events = EPOLLIN | EPOLLRDHUP;
+  if (epoll_ctl(getEpollData().fd, EPOLL_CTL_MOD, fd_, ep_event_) == -1)
+    throw ConErr("Failed to modify epoll event");
 }
 
 void PipeFd::checkExited(CgiResponse* response)
@@ -277,29 +249,24 @@ void PipeFd::killProcess()
 
 void PipeFd::enableSending(CgiResponse* response)
 {
-  if (response)
+  if (response && !response->resumeSending())
   {
-    int fd = response->getClientFd();
-    EpollData& ed = getEpollData();
-    if (ed.fds.find(fd) != ed.fds.end())
-    {
-      epoll_event* event = ed.fds[fd]->getEvent();
-      if (event->events == 0)
-      {
-        event->events = EPOLLOUT | EPOLLRDHUP;
-        if (epoll_ctl(ed.fd, EPOLL_CTL_MOD, fd, event) == -1)
-        {
-          killProcess();
-          process_finished_ = true;
-        }
-      }
-    }
+    killProcess();
+    process_finished_ = true;
   }
 }
 
-size_t PipeFd::getStartTime() const
+/*
+ * The time the output is paused for a slow client doesn't count towards the
+ * timeout of the script
+ */
+u_int64_t PipeFd::getDeadline() const
 {
-  return start_time_;
+  u_int64_t deadline =
+      start_time_ + Configuration::getInstance().getCgiTimeout();
+  if (paused_since_ > 0)
+    deadline += Utils::getCurrentTime() - paused_since_;
+  return deadline;
 }
 
 Response* PipeFd::getResponse() const
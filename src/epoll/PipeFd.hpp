@@ -16,10 +16,10 @@ class PipeFd : public EpollFd
  public:
   // ── ◼︎ constructor, destructor
   // ───────────────────────
-  PipeFd(std::string& write_buffer,
-         const std::string& skript_path,
+  PipeFd(const std::string& skript_path,
          const std::string& cgi_path,
          const std::string& file_path,
+         int input_fd,
          Response* cgi_response,
          char** envp,
          RequestMethod method);
@@ -27,7 +27,8 @@ class PipeFd : public EpollFd
 
   EpollAction epollCallback(int event);
   void unsetResponse(void);
-  size_t getStartTime() const;
+  void resumeReading(void);
+  u_int64_t getDeadline() const;
   Response* getResponse() const;
 
  private:
@@ -38,20 +39,21 @@ class PipeFd : public EpollFd
   int process_id_;
   bool process_finished_;
   char read_buffer_[CHUNK_SIZE];
-  std::string& write_buffer_;
   std::string bin_path_;
   std::string skript_path_;
   std::string file_path_;
+  int input_fd_;  // Read end of a BodyPipe, -1 if the body is in file_path_
   Response* cgi_response_;
   size_t start_time_;
+  u_int64_t paused_since_;  // Output is over the high mark, 0 if it isn't
   RequestMethod method_;
-  int stdin_;
   // ── ◼︎ utils ───────────────────────
   void closePipe();
-  void spawnCGI(char** envp);
+  pid_t spawnCGI(char** envp);
   void checkExited(CgiResponse* response);
   void killProcess();
   void enableSending(CgiResponse* response);
+  EpollAction pauseReading(void);
 
   // ── ◼︎ disabled ───────────────────────
   PipeFd();
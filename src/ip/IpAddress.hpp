@@ -15,7 +15,7 @@ class IpAddress
       : address_(address), type_(type)
   {}
   virtual ~IpAddress();
-  virtual int createSocket() const = 0;
+  virtual int createSocket(bool reuse_port) const = 0;
 
   virtual bool operator<(const IpAddress& other) const = 0;
   virtual bool operator==(const IpAddress& other) const = 0;
@@ -55,7 +55,7 @@ Ipv4Address::Ipv4Address(u_int32_t ip,
 
 Ipv4Address::~Ipv4Address() {}
 
-int Ipv4Address::createSocket() const
+int Ipv4Address::createSocket(bool reuse_port) const
 {
   struct sockaddr_in addr;
 
@@ -75,6 +75,15 @@ int Ipv4Address::createSocket() const
     throw Fatal("Unable to set socket options");
   }
 
+  // Lets every worker process bind its own socket to the same address, the
+  // kernel then distributes incoming connections between them
+  if (reuse_port &&
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) == -1)
+  {
+    close(fd);
+    throw Fatal("Unable to set SO_REUSEPORT on socket");
+  }
+
   if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
   {
     close(fd);
@@ -7,7 +7,7 @@ class Ipv4Address : public IpAddress
   Ipv4Address(u_int32_t ip, u_int16_t port, const std::string& original);
   ~Ipv4Address();
 
-  int createSocket() const;
+  int createSocket(bool reuse_port) const;
   bool operator<(const IpAddress& other) const;
   bool operator==(const IpAddress& other) const;
   u_int32_t getIp() const;
@@ -77,7 +77,7 @@ Ipv6Address::Ipv6Address(Ipv6 ip, u_int16_t port, const std::string& original)
 
 Ipv6Address::~Ipv6Address() {}
 
-int Ipv6Address::createSocket() const
+int Ipv6Address::createSocket(bool reuse_port) const
 {
   struct sockaddr_in6 addr;
 
@@ -98,6 +98,15 @@ int Ipv6Address::createSocket() const
     throw Fatal("Unable to set socket options");
   }
 
+  // Lets every worker process bind its own socket to the same address, the
+  // kernel then distributes incoming connections between them
+  if (reuse_port &&
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) == -1)
+  {
+    close(fd);
+    throw Fatal("Unable to set SO_REUSEPORT on socket");
+  }
+
   if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
   {
     close(fd);
@@ -23,7 +23,7 @@ class Ipv6Address : public IpAddress
   bool operator==(const IpAddress& other) const;
 
   // ── ◼︎ member functions ─────────────────────────
-  int createSocket() const;
+  int createSocket(bool reuse_port) const;
 
   // ── ◼︎ getters ──────────────────────────────────
   const u_int16_t* getIp() const;
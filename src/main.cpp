@@ -6,6 +6,7 @@
 #include <csignal>
 #include <cstddef>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <exception>
 #include <iostream>
@@ -24,9 +25,18 @@ void setup_signals(void)
   int catch_signals[] = {SIGINT, SIGQUIT, SIGHUP, SIGTERM, 0};
   int ignore_signals[] = {SIGUSR1, SIGUSR2, SIGPIPE, 0};
 
+  /*
+   * No SA_RESTART, blocking calls like waitpid in the master process need to
+   * be interrupted to notice the signal
+   */
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_handler = handle_signal;
+  sigemptyset(&action.sa_mask);
+
   for (size_t i = 0; catch_signals[i]; ++i)
   {
-    signal(catch_signals[i], handle_signal);
+    sigaction(catch_signals[i], &action, NULL);
   }
 
   for (size_t i = 0; ignore_signals[i]; ++i)
@@ -1,62 +1,50 @@
-#include <sstream>
 #include <string>
 #include "../exceptions/RequestError.hpp"
 #include "Parsing.hpp"
 
 namespace Parsing
 {
-  size_t getChunkHeaderSize(const std::string& line)
+  size_t getChunkHeaderSize(Cursor line)
   {
-    std::istringstream ss(line);
-    int c;
-
-    long chunk_size = read_hex(ss);
-    if (chunk_size < 0)
-      throw RequestError(400, "Negative chunk size");
-    while (!ss.fail())
+    size_t chunk_size = read_hex(line);
+    while (true)
     {
-      skip_ows(ss);
-      if (ss.fail())
+      skip_ows(line);
+      if (line.atEnd())
         break;
-      c = ss.get();
-      if (ss.fail() || c != ';')
+      if (line.get() != ';')
         throw RequestError(400, "Semicolon not found after BWS");
-      skip_ows(ss);
-      skip_token(ss);
-      skip_ows(ss);
-      if (ss.fail())
+      skip_ows(line);
+      skip_token(line);
+      skip_ows(line);
+      if (line.atEnd())
         break;
-      c = ss.get();
-      if (ss.fail())
-        throw RequestError(400, "= or ; not found");
-      if (c == '=')
+      if (line.peek() == '=')
       {
-        skip_ows(ss);
-        c = ss.get();
-        if (ss.fail())
+        ++line.pos;
+        skip_ows(line);
+        if (line.atEnd())
           throw RequestError(400, "No character after equal sign");
-        if (c == '"')
-          validateQuotedString(ss);
+        if (line.get() == '"')
+          validateQuotedString(line);
         else
         {
-          ss.unget();
-          skip_token(ss);
+          line.unget();
+          skip_token(line);
         }
       }
-      else
-      {
-        ss.unget();
-        ss.unget();
-      }
     }
 
-    return static_cast< size_t >(chunk_size);
+    return chunk_size;
   }
 
-  // Just ignore return value since we most likely don't have a use for the
-  // trailing section anyway
-  void validateChunkTrailer(const std::string& line)
+  // Just ignore the parsed fields since we most likely don't have a use for
+  // the trailing section anyway
+  void validateChunkTrailer(Cursor line)
   {
-    Parsing::parseFieldLine(line);
+    std::string name;
+    std::string value;
+
+    Parsing::parseFieldLine(line, name, value);
   }
 }  // namespace Parsing
@@ -1,16 +1,10 @@
 #include "Parsing.hpp"
 #include <cctype>
-#include <cstdlib>
-#include <iostream>
-#include <sstream>
-#include <utility>
+#include <cstring>
 #include "../exceptions/RequestError.hpp"
 
 namespace Parsing
 {
-  using std::istringstream;
-  using std::string;
-
   static const std::pair< char, char > TCHAR_TOKEN_RANGES[] = {
       std::make_pair('#', '\''),
       std::make_pair('*', '+'),
@@ -24,28 +18,125 @@ namespace Parsing
 
   static const char SUB_DELIMS_SOLO_TOKENS[] = {'!', '$', ';', '='};
 
-  static inline bool __attribute__((always_inline)) is_tchar(int c)
+  enum CharClass
   {
-    if (std::isalnum(c))
-      return true;
+    TCHAR = 1,
+    UNRESERVED = 2,
+    SUB_DELIMS = 4,
+    PCHAR = 8,       // Without pct-encoded
+    FIELD_CHAR = 16  // VCHAR, SP and HTAB
+  };
+
+  /*
+   * The classes of all 256 characters, so the checks in the parsing loops
+   * are a single lookup instead of walking the ranges above every time
+   */
+  struct CharClasses
+  {
+    CharClasses()
+    {
+      for (int c = 0; c < 256; ++c)
+      {
+        flags[c] = 0;
+        if (computeTchar(c))
+          flags[c] |= TCHAR;
+        if (std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~')
+          flags[c] |= UNRESERVED;
+        if (computeSubDelims(c))
+          flags[c] |= SUB_DELIMS;
+        if ((flags[c] & (UNRESERVED | SUB_DELIMS)) || c == ':' || c == '@')
+          flags[c] |= PCHAR;
+        if (is_vchar(c) || is_space(c))
+          flags[c] |= FIELD_CHAR;
+      }
+    }
 
-    unsigned int token_ranges_count =
-        sizeof(TCHAR_TOKEN_RANGES) / sizeof(TCHAR_TOKEN_RANGES[0]);
-    for (unsigned int i = 0; i < token_ranges_count; ++i)
+    static bool computeTchar(int c)
     {
-      if (c >= TCHAR_TOKEN_RANGES[i].first && c <= TCHAR_TOKEN_RANGES[i].second)
+      if (std::isalnum(c))
         return true;
+
+      unsigned int token_ranges_count =
+          sizeof(TCHAR_TOKEN_RANGES) / sizeof(TCHAR_TOKEN_RANGES[0]);
+      for (unsigned int i = 0; i < token_ranges_count; ++i)
+      {
+        if (c >= TCHAR_TOKEN_RANGES[i].first &&
+            c <= TCHAR_TOKEN_RANGES[i].second)
+          return true;
+      }
+
+      unsigned int solo_tokens_count =
+          sizeof(TCHAR_SOLO_TOKENS) / sizeof(TCHAR_SOLO_TOKENS[0]);
+      for (unsigned int i = 0; i < solo_tokens_count; ++i)
+      {
+        if (c == TCHAR_SOLO_TOKENS[i])
+          return true;
+      }
+
+      return false;
     }
 
-    unsigned int solo_tokens_count =
-        sizeof(TCHAR_SOLO_TOKENS) / sizeof(TCHAR_SOLO_TOKENS[0]);
-    for (unsigned int i = 0; i < solo_tokens_count; ++i)
+    static bool computeSubDelims(int c)
     {
-      if (c == TCHAR_SOLO_TOKENS[i])
+      if (c >= SUB_DELIMS_RANGE.first && c <= SUB_DELIMS_RANGE.second)
         return true;
+      unsigned int amount =
+          sizeof(SUB_DELIMS_SOLO_TOKENS) / sizeof(SUB_DELIMS_SOLO_TOKENS[0]);
+
+      for (unsigned int i = 0; i < amount; ++i)
+      {
+        if (c == SUB_DELIMS_SOLO_TOKENS[i])
+          return true;
+      }
+
+      return false;
     }
 
-    return false;
+    unsigned char flags[256];
+  };
+
+  static const CharClasses CHAR_CLASSES;
+
+  static inline bool __attribute__((always_inline))
+  has_class(int c, CharClass char_class)
+  {
+    return CHAR_CLASSES.flags[static_cast< unsigned char >(c)] & char_class;
+  }
+
+  static inline bool __attribute__((always_inline)) is_tchar(int c)
+  {
+    return has_class(c, TCHAR);
+  }
+
+  static int hex_value(int c)
+  {
+    if (std::isdigit(c))
+      return c - '0';
+    return std::tolower(c) - 'a' + 10;
+  }
+
+  bool Cursor::equals(const char* literal) const
+  {
+    size_t length = std::strlen(literal);
+
+    return size() == length && std::memcmp(pos, literal, length) == 0;
+  }
+
+  /*
+   * `literal` has to be lower case already
+   */
+  bool Cursor::equalsIgnoreCase(const char* literal) const
+  {
+    size_t length = std::strlen(literal);
+
+    if (size() != length)
+      return false;
+    for (size_t i = 0; i < length; ++i)
+    {
+      if (std::tolower(static_cast< unsigned char >(pos[i])) != literal[i])
+        return false;
+    }
+    return true;
   }
 
   bool is_space(int c)
@@ -69,209 +160,156 @@ namespace Parsing
     return c >= 0x21 && c <= 0x7E;
   }
 
-  long read_hex(istringstream& stream)
+  /*
+   * Reads 1*HEXDIG, values that don't fit into a size_t are rejected
+   */
+  size_t read_hex(Cursor& cursor)
   {
-    long number;
+    size_t number = 0;
 
-    stream >> std::hex >> number;
-    if (stream.fail() && !stream.eof())
-      throw RequestError(400, "Unable to convert to long");
+    if (cursor.atEnd() || !std::isxdigit(cursor.peek()))
+      throw RequestError(400, "read_hex: No hex digit");
+    while (!cursor.atEnd() && std::isxdigit(cursor.peek()))
+    {
+      if (number > (static_cast< size_t >(-1) >> 4))
+        throw RequestError(400, "read_hex: Number too large");
+      number = number * 16 + hex_value(cursor.get());
+    }
     return number;
   }
 
-  char read_pct_encoded(istringstream& stream)
+  char read_pct_encoded(Cursor& cursor)
   {
-    int c, c2;
-    char chars[3];
-    long number;
-
-    c = stream.get();
-    c2 = stream.get();
-    if (stream.fail())
+    if (cursor.size() < 2)
       throw RequestError(400, "read_pct_encoded: Unable to get two characters");
-    if (!isxdigit(c) || !isxdigit(c2))
+    int c = cursor.get();
+    int c2 = cursor.get();
+    if (!std::isxdigit(c) || !std::isxdigit(c2))
       throw RequestError(400, "read_pct_encoded: non hex character");
-    chars[0] = c;
-    chars[1] = c2;
-    chars[2] = '\0';
-
-    number = std::strtol(chars, NULL, 16);
-    return static_cast< char >(number);
-  }
-
-  void skip_hexadecimal(const string& input, string::size_type& pos)
-  {
-    if (pos >= input.length())
-      throw RequestError(400, "Skip Hex: String too short");
-    if (!std::isxdigit(input[pos]))
-      throw RequestError(400, "Skip Hex: First character not hex");
-    pos++;
-    while (pos < input.length() && std::isxdigit(input[pos]))
-      pos++;
+    return static_cast< char >(hex_value(c) * 16 + hex_value(c2));
   }
 
-  void skip_ows(istringstream& stream)
+  void skip_ows(Cursor& cursor)
   {
-    int c;
-
-    while (true)
-    {
-      c = stream.get();
-      if (stream.fail())
-        break;
-      if (!is_space(c))
-      {
-        stream.unget();
-        break;
-      }
-    }
+    while (!cursor.atEnd() && is_space(cursor.peek()))
+      ++cursor.pos;
   }
 
-  void skip_token(istringstream& stream)
+  void skip_token(Cursor& cursor)
   {
-    int c;
-
-    c = stream.get();
-    if (stream.fail())
+    if (cursor.atEnd())
       throw RequestError(400, "Skip Token: String too short");
-    if (!is_tchar(c))
+    if (!is_tchar(cursor.peek()))
       throw RequestError(400, "Skip Token: First character not tchar");
-    while (true)
-    {
-      c = stream.get();
-      if (stream.fail())
-        break;
-      if (!is_tchar(c))
-      {
-        stream.unget();
-        break;
-      }
-    }
+    while (++cursor.pos != cursor.end && is_tchar(*cursor.pos))
+      ;
   }
 
-  string get_token(istringstream& stream)
+  /*
+   * Returns the token as a cursor pointing into the input
+   */
+  Cursor get_token(Cursor& cursor)
   {
-    string token;
-    int c;
+    const char* start = cursor.pos;
 
-    c = stream.get();
-    if (stream.fail())
+    if (cursor.atEnd())
       throw RequestError(400, "get_token: String too short");
-    if (!is_tchar(c))
+    if (!is_tchar(cursor.peek()))
       throw RequestError(400, "get_token: First character not tchar");
-    token += c;
-    while (true)
-    {
-      c = stream.get();
-      if (stream.fail())
-        break;
-      if (!is_tchar(c))
-      {
-        stream.unget();
-        break;
-      }
-      token += c;
-    }
-
-    return token;
+    while (++cursor.pos != cursor.end && is_tchar(*cursor.pos))
+      ;
+    return Cursor(start, cursor.pos);
   }
 
-  void skip_character(istringstream& stream, char expected)
+  void skip_character(Cursor& cursor, char expected)
   {
-    int c;
-
-    c = stream.get();
-    if (stream.fail())
+    if (cursor.atEnd())
       throw RequestError(400, "skip_character: Already at EOF");
-    if (c != expected)
+    if (*cursor.pos++ != expected)
       throw RequestError(400, "skip_character: Wrong character");
   }
 
-  bool get_pchar(std::istringstream& stream, int& c)
+  bool get_pchar(Cursor& cursor, int& c)
   {
-    int tmp;
-    tmp = stream.get();
-    if (stream.fail())
+    if (cursor.atEnd())
       return false;
+    int tmp = cursor.peek();
     if (tmp == '%')
     {
-      c = read_pct_encoded(stream);
+      ++cursor.pos;
+      c = read_pct_encoded(cursor);
       return true;
     }
-    else if (is_unreserved(tmp) || is_sub_delims(tmp) || tmp == ':' ||
-             tmp == '@')
+    else if (has_class(tmp, PCHAR))
     {
+      ++cursor.pos;
       c = tmp;
       return (true);
     }
-    else
-    {
-      stream.unget();
-      return (false);
-    }
+    return (false);
   }
 
   bool is_unreserved(int c)
   {
-    if (std::isalnum(c))
-      return (true);
-    switch (c)
-    {
-      case '-':
-      case '.':
-      case '_':
-      case '~':
-        return true;
-      default:
-        return false;
-    }
+    return has_class(c, UNRESERVED);
   }
 
   bool is_sub_delims(int c)
   {
-    if (c >= SUB_DELIMS_RANGE.first && c <= SUB_DELIMS_RANGE.second)
-      return true;
-    unsigned int amount =
-        sizeof(SUB_DELIMS_SOLO_TOKENS) / sizeof(SUB_DELIMS_SOLO_TOKENS[0]);
-
-    for (unsigned int i = 0; i < amount; ++i)
-    {
-      if (c == SUB_DELIMS_SOLO_TOKENS[i])
-        return true;
-    }
-
-    return false;
+    return has_class(c, SUB_DELIMS);
   }
 
-  string get_segment(std::istringstream& stream)
+  /*
+   * Returns the first character that isn't allowed in a field value, or
+   * `end`. Eight characters get checked at once while they are all in
+   * 0x20-0x7E, only words containing anything else (HTAB or an invalid
+   * character) are looked at one by one.
+   */
+  const char* skip_field_content(const char* pos, const char* end)
   {
-    string segment;
-    int c;
+    const u_int64_t ones = ~static_cast< u_int64_t >(0) / 255;
+    const u_int64_t high_bits = ones * 0x80;
 
-    while (get_pchar(stream, c))
-      segment += static_cast< char >(c);
-
-    return segment;
+    while (end - pos >= 8)
+    {
+      u_int64_t word;
+      std::memcpy(&word, pos, sizeof(word));
+      // High bit set in a byte that's below 0x20 or above 0x7E
+      u_int64_t below = (word - ones * 0x20) & ~word;
+      u_int64_t above = (word + ones) | word;
+      if (((below | above) & high_bits) != 0)
+      {
+        for (const char* it = pos; it != pos + 8; ++it)
+        {
+          if (!has_class(*it, FIELD_CHAR))
+            return it;
+        }
+      }
+      pos += 8;
+    }
+    while (pos != end && has_class(*pos, FIELD_CHAR))
+      ++pos;
+    return pos;
   }
 
-  void validateQuotedString(std::istringstream& stream)
+  void validateQuotedString(Cursor& cursor)
   {
     int c;
 
     while (true)
     {
-      c = stream.get();
-      if (stream.fail())
+      if (cursor.atEnd())
         throw RequestError(400, "Unclosed quote");
+      c = cursor.get();
       if (c == '"')
         return;
       if (is_qdtext(c))
         ;
       else if (c == '\\')
       {
-        c = stream.get();
-        if (stream.fail())
+        if (cursor.atEnd())
           throw RequestError(400, "EOF after Backslash");
+        c = cursor.get();
         if (!is_space(c) && !is_vchar(c) && !is_obs_text(c))
           throw RequestError(400, "Invalid character in quoted string");
       }
@@ -1,34 +1,80 @@
 #pragma once
 
 #include <sys/types.h>
-#include <sstream>
+#include <cstddef>
+#include <string>
+#include <utility>
 
 namespace Parsing
 {
+  /*
+   * Read position within a line that is still in the connection buffer (or
+   * any other string), so nothing has to be copied before it's parsed.
+   * get() has the same semantics as istream::get() apart from never failing,
+   * callers check atEnd() first.
+   */
+  struct Cursor
+  {
+    const char* pos;
+    const char* end;
+
+    Cursor(const char* begin, const char* end) : pos(begin), end(end) {}
+    Cursor(const std::string& str)
+        : pos(str.data()), end(str.data() + str.size())
+    {}
+
+    bool atEnd() const
+    {
+      return pos == end;
+    }
+    size_t size() const
+    {
+      return static_cast< size_t >(end - pos);
+    }
+    int peek() const
+    {
+      return static_cast< unsigned char >(*pos);
+    }
+    int get()
+    {
+      return static_cast< unsigned char >(*pos++);
+    }
+    void unget()
+    {
+      --pos;
+    }
+    bool equals(const char* literal) const;
+    bool equalsIgnoreCase(const char* literal) const;
+    std::string str() const
+    {
+      return std::string(pos, end);
+    }
+  };
+
   bool is_space(int c);
   bool is_qdtext(int c);
   bool is_obs_text(int c);
   bool is_vchar(int c);
-  bool get_pchar(std::istringstream& stream, int& c);
+  bool get_pchar(Cursor& cursor, int& c);
   bool is_unreserved(int c);
   bool is_sub_delims(int c);
 
-  long read_hex(std::istringstream& stream);
-  char read_pct_encoded(std::istringstream& stream);
-  void skip_ows(std::istringstream& stream);
-  void skip_token(std::istringstream& stream);
-  void skip_character(std::istringstream& stream, char expected);
-  void validateQuotedString(std::istringstream& stream);
-
-  size_t getChunkHeaderSize(const std::string& line);
-  void validateChunkTrailer(const std::string& line);
-  std::string get_token(std::istringstream& stream);
-  std::string get_segment(std::istringstream& stream);
-
-  std::pair< std::string, std::string > parseFieldLine(const std::string& line);
-  std::string processQueryString(const std::string query);
-  std::string processPath(const std::string path);
-  std::pair< std::string, u_int16_t > parseHost(const std::string& host);
-  void validateUserinfo(const std::string& userinfo);
-  void validateCookies(const std::string& cookies);
+  size_t read_hex(Cursor& cursor);
+  char read_pct_encoded(Cursor& cursor);
+  void skip_ows(Cursor& cursor);
+  void skip_token(Cursor& cursor);
+  void skip_character(Cursor& cursor, char expected);
+  void validateQuotedString(Cursor& cursor);
+  const char* skip_field_content(const char* pos, const char* end);
+
+  size_t getChunkHeaderSize(Cursor line);
+  void validateChunkTrailer(Cursor line);
+  Cursor get_token(Cursor& cursor);
+
+  void parseFieldLine(Cursor line, std::string& name, std::string& value);
+  void processQueryString(Cursor query, std::string& escaped);
+  void processPath(Cursor path, std::string& escaped);
+  std::pair< std::string, u_int16_t > parseHost(Cursor host);
+  void validateUserinfo(Cursor userinfo);
+  void validateCookies(Cursor cookies);
 }  // namespace Parsing
@@ -1,110 +1,103 @@
 #include <netdb.h>
 #include <sys/socket.h>
 #include <sys/types.h>
-#include <algorithm>
-#include <cstdio>
+#include <cctype>
 #include <cstring>
-#include <iostream>
-#include <sstream>
 #include <string>
-#include <vector>
 #include "../exceptions/RequestError.hpp"
-#include "../utils/Utils.hpp"
 #include "Parsing.hpp"
 
 namespace Parsing
 {
-  using std::istringstream;
   using std::pair;
   using std::string;
-  using std::vector;
 
   static void validateIpv6(const std::string& ipv6);
-  static string escapeHostname(const std::string& hostname);
-  static u_int16_t parsePort(const std::string& host);
-  static void parseCookiePair(istringstream& stream);
-  static void skipCookieOctets(istringstream& stream);
-  static std::string getFieldContent(std::istringstream& stream);
+  static void escapeHostname(Cursor hostname, std::string& escaped);
+  static u_int16_t parsePort(Cursor port);
+  static void parseCookiePair(Cursor& cursor);
+  static void skipCookieOctets(Cursor& cursor);
+  static void endSegment(string& path, string::size_type& segment);
 
-  string processQueryString(const string query)
+  void processQueryString(Cursor query, string& escaped)
   {
-    istringstream ss(query);
-    string escaped;
     int c;
 
-    while (true)
+    escaped.clear();
+    while (!query.atEnd())
     {
-      if (get_pchar(ss, c))
+      if (get_pchar(query, c))
       {
         escaped += static_cast< char >(c);
         continue;
       }
-      c = ss.get();
-      if (ss.fail())
-        break;
+      c = query.get();
       if (c != '/' && c != '?')
         throw RequestError(400, "Invalid character in query section");
       escaped += static_cast< char >(c);
     }
-    return escaped;
   }
 
-  string processPath(const string path)
+  /*
+   * Decodes the path straight into `escaped`. Percent-encoded slashes split
+   * segments as well, empty segments are dropped and ".." removes the
+   * previous one. A trailing slash of the input is kept.
+   */
+  void processPath(Cursor path, string& escaped)
   {
-    istringstream ss(path);
-    vector< string > segments;
+    string::size_type segment = 1;
     int c;
 
-    while (true)
+    escaped.assign(1, '/');
+    bool trailing_slash = !path.atEnd() && path.end[-1] == '/';
+    if (path.atEnd() || path.get() != '/')
+      throw RequestError(400,
+                         "Unexpected character in processPath(expected /");
+    while (!path.atEnd())
     {
-      c = ss.get();
-      if (ss.fail())
-        break;
-      if (c != '/')
+      if (!get_pchar(path, c) && (c = path.get()) != '/')
         throw RequestError(400,
                            "Unexpected character in processPath(expected /");
-      string segment = get_segment(ss);
-      if (segment.empty())
-        continue;
-      std::istringstream ss(segment);
-      string subsegment;
-      while (std::getline(ss, subsegment, '/'))
-      {
-        if (subsegment.empty())
-          continue;
-        if (subsegment == "..")
-        {
-          if (!segments.empty())
-            segments.pop_back();
-        }
-        else
-          segments.push_back(subsegment);
-      }
+      if (c == '/')
+        endSegment(escaped, segment);
+      else
+        escaped += static_cast< char >(c);
     }
+    endSegment(escaped, segment);
 
-    string escaped;
-    vector< string >::iterator it;
-    for (it = segments.begin(); it != segments.end(); ++it)
-      escaped += "/" + *it;
-
-    if (escaped.empty() || path[path.length() - 1] == '/')
-      escaped += '/';
+    if (escaped.size() > 1 && !trailing_slash)
+      escaped.resize(escaped.size() - 1);
+  }
 
-    return escaped;
+  /*
+   * `segment` is the start of the last segment in `path`, afterwards the path
+   * ends with a slash and `segment` points behind it
+   */
+  static void endSegment(string& path, string::size_type& segment)
+  {
+    if (segment == path.size())
+      return;
+    if (path.compare(segment, string::npos, "..") == 0)
+    {
+      path.resize(segment);
+      if (segment > 1)
+        segment = path.rfind('/', segment - 2) + 1;
+      path.resize(segment);
+      return;
+    }
+    path += '/';
+    segment = path.size();
   }
 
-  void validateUserinfo(const std::string& userinfo)
+  void validateUserinfo(Cursor userinfo)
   {
-    std::istringstream ss(userinfo);
     int c;
 
-    while (true)
+    while (!userinfo.atEnd())
     {
-      c = ss.get();
-      if (ss.fail())
-        break;
+      c = userinfo.get();
       if (c == '%')
-        read_pct_encoded(ss);
+        read_pct_encoded(userinfo);
       else if (is_unreserved(c) || is_sub_delims(c) || c == ':')
         ;
       else
@@ -112,38 +105,44 @@ namespace Parsing
     }
   }
 
-  pair< string, u_int16_t > parseHost(const string& host)
+  pair< string, u_int16_t > parseHost(Cursor host)
   {
-    string::size_type pos;
-    string hostname(host);
-    string port_str;
+    Cursor hostname = host;
+    Cursor port_str(host.end, host.end);
+    string escaped;
 
-    pos = hostname.find_last_of(":]");
-    if (pos != string::npos && hostname[pos] == ':')
+    for (const char* it = host.end; it != host.pos; --it)
     {
-      port_str = hostname.substr(pos);
-      hostname = hostname.substr(0, pos);
+      if (it[-1] == ']')
+        break;
+      if (it[-1] == ':')
+      {
+        hostname.end = it - 1;
+        port_str.pos = it - 1;
+        break;
+      }
     }
 
-    if (hostname.empty())
+    if (hostname.atEnd())
       throw RequestError(400, "parse Host: empty hostname");
-    if (hostname[0] == '[')
+    if (hostname.peek() == '[')
     {
-      pos = hostname.find(']');
-      if (pos == string::npos)
+      const char* bracket = static_cast< const char* >(
+          std::memchr(hostname.pos, ']', hostname.size()));
+      if (!bracket)
         throw RequestError(400, "parse host: closing bracket of ipv6 missing");
-      if (pos != hostname.length() - 1)
+      if (bracket != hostname.end - 1)
         throw RequestError(
             400, "parse host: unexpected content after ipv6 closing bracket");
-      validateIpv6(hostname.substr(1, pos - 1));
-      hostname = hostname.substr(0, pos + 1);
+      validateIpv6(string(hostname.pos + 1, bracket));
+      escaped = hostname.str();
     }
     else
-      hostname = escapeHostname(hostname);
+      escapeHostname(hostname, escaped);
 
     u_int16_t port = parsePort(port_str);
 
-    return std::make_pair(hostname, port);
+    return std::make_pair(escaped, port);
   }
 
   static void validateIpv6(const std::string& ipv6)
@@ -161,149 +160,113 @@ namespace Parsing
       freeaddrinfo(result);
   }
 
-  static string escapeHostname(const std::string& hostname)
+  static void escapeHostname(Cursor hostname, string& escaped)
   {
-    istringstream ss(hostname);
-    string escaped;
     int c;
 
-    while (true)
+    while (!hostname.atEnd())
     {
-      c = ss.get();
-      if (ss.fail())
-        break;
+      c = hostname.get();
       if (c == '%')
-        escaped += read_pct_encoded(ss);
+        escaped += read_pct_encoded(hostname);
       else if (is_unreserved(c) || is_sub_delims(c))
-        escaped += c;
+        escaped += static_cast< char >(c);
       else
         throw RequestError(400, "Invalid character in userinfo");
     }
-
-    return escaped;
   }
 
-  static u_int16_t parsePort(const std::string& port_str)
+  static u_int16_t parsePort(Cursor port_str)
   {
-    std::istringstream ss(port_str);
-    int c;
-    u_int16_t port;
+    unsigned long port = 0;
 
-    c = ss.get();
-    if (ss.fail())
+    if (port_str.atEnd())
       return (80);
-    if (c != ':')
+    if (port_str.get() != ':')
       throw RequestError(400, "parsePort: ':' not found");
-    c = ss.get();
-    if (ss.fail())
+    if (port_str.atEnd())
       return (80);
-    if (!std::isdigit(c))
+    if (!std::isdigit(port_str.peek()))
       throw RequestError(400, "parsePort: Non-numeric character after ':'");
-    ss.unget();
 
-    if (!(ss >> port))
-      throw RequestError(400, "parsePort: Port outside the range");
-    if (!ss.eof())
+    while (!port_str.atEnd() && std::isdigit(port_str.peek()))
+    {
+      port = port * 10 + (port_str.get() - '0');
+      if (port > 65535)
+        throw RequestError(400, "parsePort: Port outside the range");
+    }
+    if (!port_str.atEnd())
       throw RequestError(400, "parsePort: unexpected content after port");
-    return port;
+    return static_cast< u_int16_t >(port);
   }
 
-  void validateCookies(const std::string& cookies)
+  void validateCookies(Cursor cookies)
   {
-    int c;
-    istringstream ss(cookies);
-
-    parseCookiePair(ss);
-    while (true)
+    parseCookiePair(cookies);
+    while (!cookies.atEnd())
     {
-      c = ss.get();
-      if (ss.fail())
-        break;
-      if (c != ';')
+      if (cookies.get() != ';')
         throw RequestError(
             400, "validateCookies: Invalid character, expected semicolon");
-      skip_character(ss, ' ');
-      parseCookiePair(ss);
+      skip_character(cookies, ' ');
+      parseCookiePair(cookies);
     }
   }
 
-  static void parseCookiePair(istringstream& stream)
+  static void parseCookiePair(Cursor& cursor)
   {
-    int c;
-
-    skip_token(stream);
-    c = stream.get();
-    if (stream.fail())
-      throw("parseCookiePair: EOF reached, expected =");
-    if (c != '=')
-      throw("parseCookiePair: Invalid character, expected =");
-    c = stream.get();
-    if (stream.fail())
+    skip_token(cursor);
+    if (cursor.atEnd())
+      throw RequestError(400, "parseCookiePair: EOF reached, expected =");
+    if (cursor.get() != '=')
+      throw RequestError(400, "parseCookiePair: Invalid character, expected =");
+    if (cursor.atEnd())
       return;
-    if (c == '"')
+    if (cursor.peek() == '"')
     {
-      skipCookieOctets(stream);
-      c = stream.get();
-      if (stream.fail() || c != '"')
-        throw("parseCookiePair: Unclosed double quote");
+      ++cursor.pos;
+      skipCookieOctets(cursor);
+      if (cursor.atEnd() || cursor.get() != '"')
+        throw RequestError(400, "parseCookiePair: Unclosed double quote");
     }
     else
-      skipCookieOctets(stream);
+      skipCookieOctets(cursor);
   }
 
-  static void skipCookieOctets(istringstream& stream)
+  static void skipCookieOctets(Cursor& cursor)
   {
-    int c;
-
-    while (true)
+    while (!cursor.atEnd())
     {
-      c = stream.get();
-      if (stream.fail())
-        break;
+      int c = cursor.peek();
       if (c < 0x21 || c > 0x7E || c == 0x22 || c == 0x2C || c == 0x3B ||
           c == 0x5C)
-      {
-        stream.unget();
         break;
-      }
+      ++cursor.pos;
     }
   }
 
-  pair< string, string > parseFieldLine(const std::string& line)
-  {
-    std::istringstream ss(line);
-    std::string name = Parsing::get_token(ss);
-    Parsing::skip_character(ss, ':');
-    Parsing::skip_ows(ss);
-    std::string value = getFieldContent(ss);
-
-    std::for_each(name.begin(), name.end(), Utils::toLower);
-    return std::make_pair(name, value);
-  }
-
-  static std::string getFieldContent(std::istringstream& stream)
+  /*
+   * The name gets lower-cased while it's copied, trailing whitespace of the
+   * value is never copied in the first place
+   */
+  void parseFieldLine(Cursor line, string& name, string& value)
   {
-    std::string content;
-    std::string::size_type pos;
-    int c;
-
-    c = stream.get();
-    if (stream.fail())
+    Cursor token = get_token(line);
+    skip_character(line, ':');
+    skip_ows(line);
+    if (line.atEnd())
       throw RequestError(400, "Missing field content");
 
-    do
-    {
-      if (!Parsing::is_vchar(c) && !Parsing::is_space(c))
-        throw RequestError(400, "Invalid character in field value");
-
-      content += c;
-      c = stream.get();
-    } while (stream.good());
-
-    pos = content.find_last_not_of("\t ");
-    if (pos != std::string::npos)
-      content = content.substr(0, pos + 1);
-
-    return content;
+    if (skip_field_content(line.pos, line.end) != line.end)
+      throw RequestError(400, "Invalid character in field value");
+    // Can't run past the start, the first character isn't whitespace
+    const char* content_end = line.end;
+    while (is_space(content_end[-1]))
+      --content_end;
+
+    name.resize(token.size());
+    for (size_t i = 0; i < name.size(); ++i)
+      name[i] = static_cast< char >(std::tolower(token.get()));
+    value.assign(line.pos, content_end);
   }
 }  // namespace Parsing
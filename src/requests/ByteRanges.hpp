@@ -0,0 +1,19 @@
+#pragma once
+
+#include <sys/types.h>
+#include <vector>
+
+// More ranges than this in one request make the Range header get ignored
+#define RANGES_MAX 16
+
+/*
+ * One range of a `Range: bytes=...` header, -1 marks an omitted position:
+ * `first` for suffix ranges like "-500", `last` for open ones like "100-"
+ */
+struct ByteRange
+{
+  off_t first;
+  off_t last;
+};
+
+typedef std::vector< ByteRange > VByteRanges;
@@ -9,6 +9,7 @@ typedef std::map< std::string, std::string > mHeader;
 struct CgiVars
 {
   std::string input_file;
+  bool input_streamed;  // The body goes to a pipe instead of input_file
   RequestMethod request_method_enum_;
   long file_size;
   std::string request_method_str;
@@ -0,0 +1,86 @@
+#include "HeaderFields.hpp"
+#include <cstddef>
+
+struct KnownHeader
+{
+  const char* name;
+  HeaderId id;
+};
+
+static const KnownHeader KNOWN_HEADERS[] = {
+    {"host", HEADER_HOST},
+    {"content-length", HEADER_CONTENT_LENGTH},
+    {"transfer-encoding", HEADER_TRANSFER_ENCODING},
+    {"connection", HEADER_CONNECTION},
+    {"cookie", HEADER_COOKIE},
+    {"range", HEADER_RANGE},
+    {"if-range", HEADER_IF_RANGE},
+    {"if-none-match", HEADER_IF_NONE_MATCH},
+    {"if-modified-since", HEADER_IF_MODIFIED_SINCE},
+    {"accept-encoding", HEADER_ACCEPT_ENCODING},
+    {"content-type", HEADER_CONTENT_TYPE},
+    {"x-filename", HEADER_X_FILENAME}};
+
+HeaderFields::HeaderFields()
+{
+  for (int i = 0; i < HEADER_KNOWN_COUNT; ++i)
+    slots_[i] = -1;
+}
+
+/*
+ * `name` has to be lower case already
+ */
+HeaderId HeaderFields::identify(const std::string& name)
+{
+  size_t count = sizeof(KNOWN_HEADERS) / sizeof(KNOWN_HEADERS[0]);
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    if (name == KNOWN_HEADERS[i].name)
+      return KNOWN_HEADERS[i].id;
+  }
+  return HEADER_OTHER;
+}
+
+/*
+ * Returns NULL if the header wasn't sent
+ */
+const std::string* HeaderFields::get(HeaderId id) const
+{
+  if (id == HEADER_OTHER || slots_[id] == -1)
+    return NULL;
+  return &fields_[slots_[id]].value;
+}
+
+std::string* HeaderFields::find(HeaderId id, const std::string& name)
+{
+  if (id != HEADER_OTHER)
+    return (slots_[id] == -1) ? NULL : &fields_[slots_[id]].value;
+
+  for (VHeaderFields::iterator it = fields_.begin(); it != fields_.end(); ++it)
+  {
+    if (it->name == name)
+      return &it->value;
+  }
+  return NULL;
+}
+
+/*
+ * Takes over the contents of `name` and `value` without copying them, there
+ * must not be an entry with that name yet
+ */
+void HeaderFields::add(HeaderId id, std::string& name, std::string& value)
+{
+  fields_.push_back(HeaderField());
+  HeaderField& field = fields_.back();
+  field.id = id;
+  field.name.swap(name);
+  field.value.swap(value);
+  if (id != HEADER_OTHER)
+    slots_[id] = static_cast< int >(fields_.size() - 1);
+}
+
+const VHeaderFields& HeaderFields::fields() const
+{
+  return fields_;
+}
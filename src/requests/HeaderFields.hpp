@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+ * Headers the server looks at itself. They get their id while the field line
+ * is parsed, so looking them up later is an array access instead of string
+ * compares.
+ */
+enum HeaderId
+{
+  HEADER_HOST,
+  HEADER_CONTENT_LENGTH,
+  HEADER_TRANSFER_ENCODING,
+  HEADER_CONNECTION,
+  HEADER_COOKIE,
+  HEADER_RANGE,
+  HEADER_IF_RANGE,
+  HEADER_IF_NONE_MATCH,
+  HEADER_IF_MODIFIED_SINCE,
+  HEADER_ACCEPT_ENCODING,
+  HEADER_CONTENT_TYPE,
+  HEADER_X_FILENAME,
+  HEADER_KNOWN_COUNT,
+  HEADER_OTHER = HEADER_KNOWN_COUNT
+};
+
+struct HeaderField
+{
+  HeaderId id;
+  std::string name;  // Lower case
+  std::string value;
+};
+
+typedef std::vector< HeaderField > VHeaderFields;
+
+/*
+ * The request headers in the order they arrived, one entry per name. Requests
+ * rarely have more than a dozen headers, so unknown names are simply searched
+ * linearly.
+ */
+class HeaderFields
+{
+ public:
+  HeaderFields();
+
+  static HeaderId identify(const std::string& name);
+
+  const std::string* get(HeaderId id) const;
+  std::string* find(HeaderId id, const std::string& name);
+  void add(HeaderId id, std::string& name, std::string& value);
+  const VHeaderFields& fields() const;
+
+ private:
+  VHeaderFields fields_;
+  int slots_[HEADER_KNOWN_COUNT];  // Index into fields_, -1 if missing
+};
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cstdlib>
 #include <sstream>
 #include "../exceptions/RequestError.hpp"
 #include "../parsing/Parsing.hpp"
@@ -6,38 +7,39 @@
 #include "../utils/Utils.hpp"
 #include "Request.hpp"
 
-static bool isStandardHeader(const std::string& key);
+static bool parseRangePosition(const std::string& str, off_t& position);
 
-void Request::processHeaderLine(const std::string& line)
+void Request::processHeaderLine(const char* line, size_t length)
 {
-  if (line.empty())
+  if (length == 0)
   {
     validateHeaders();
     return processRequest();
   }
 
-  std::pair< string, string > name_value = Parsing::parseFieldLine(line);
-  string name = name_value.first;
-  string value = name_value.second;
-
-  std::for_each(name.begin(), name.end(), Utils::toLower);
+  std::string name;
+  std::string value;
+  Parsing::parseFieldLine(Parsing::Cursor(line, line + length), name, value);
 
   insertHeader(name, value);
 }
 
 /*
  * Key should already be lower-case here since it will be done in the function
- * calling this
+ * calling this. Both strings are taken over by the header fields if the name
+ * is new.
  */
-void Request::insertHeader(const std::string& key, const std::string& value)
+void Request::insertHeader(std::string& key, std::string& value)
 {
-  Option< std::string > existing = getHeader(key);
-  if (isStandardHeader(key) && existing.is_some())
+  HeaderId id = HeaderFields::identify(key);
+  std::string* existing = headers_.find(id, key);
+  if (existing && (id == HEADER_HOST || id == HEADER_CONTENT_LENGTH ||
+                   id == HEADER_TRANSFER_ENCODING))
     throw RequestError(400, "Standard Header redefined");
 
-  if (key == "cookie")
+  if (id == HEADER_COOKIE)
     Parsing::validateCookies(value);
-  else if (key == "host")
+  else if (id == HEADER_HOST)
   {
     std::pair< string, u_int16_t > host_port = Parsing::parseHost(value);
     if (host_.empty())
@@ -49,60 +51,41 @@ void Request::insertHeader(const std::string& key, const std::string& value)
     }
   }
 
-  if (existing.is_none())
-    headers_[key] = value;
+  if (!existing)
+    headers_.add(id, key, value);
   else
   {
-    std::string delim = (key != "cookie") ? ", " : "; ";
-    headers_[key] = existing.unwrap() + delim + value;
+    *existing += (id != HEADER_COOKIE) ? ", " : "; ";
+    *existing += value;
   }
 }
 
-/*
- * Key should already be lower-case here
- */
-static bool isStandardHeader(const std::string& key)
-{
-  size_t standard_header_count =
-      sizeof(STANDARD_HEADERS) / sizeof(STANDARD_HEADERS[0]);
-
-  for (size_t i = 0; i < standard_header_count; ++i)
-  {
-    if (key == STANDARD_HEADERS[i])
-      return (true);
-  }
-
-  return (false);
-}
-
 void Request::validateHeaders(void)
 {
-  Option< std::string > host = getHeader("Host");
-
-  if (host.is_none())
+  if (!getHeader(HEADER_HOST))
     throw RequestError(400, "Missing Host header");
 
-  Option< std::string > transfer_encoding = getHeader("Transfer-Encoding");
-  Option< std::string > content_length = getHeader("Content-Length");
-  Option< std::string > filename = getHeader("X-Filename");
-  if (filename.is_some())
+  const std::string* transfer_encoding = getHeader(HEADER_TRANSFER_ENCODING);
+  const std::string* content_length = getHeader(HEADER_CONTENT_LENGTH);
+  const std::string* filename = getHeader(HEADER_X_FILENAME);
+  if (filename)
   {
-    filename_ = filename.unwrap();
+    filename_ = *filename;
     if (filename_.empty())
       throw RequestError(400, "X-Filename header cannot be empty");
   }
-  if (transfer_encoding.is_some())
+  if (transfer_encoding)
   {
-    validateTransferEncoding(transfer_encoding.unwrap());
+    validateTransferEncoding(*transfer_encoding);
     if (method_ == GET || method_ == DELETE)
       closing_ = true;
-    if (content_length.is_some())
+    if (content_length)
       throw RequestError(400,
                          "Both Content-Length and Transfer-Encoding present");
   }
-  else if (content_length.is_some())
+  else if (content_length)
   {
-    validateContentLength(content_length.unwrap());
+    validateContentLength(*content_length);
     if ((method_ == GET || method_ == DELETE) && content_length_.unwrap() > 0)
       closing_ = true;
   }
@@ -117,13 +100,12 @@ static void checkInvalid(bool invalid)
 void Request::validateTransferEncoding(const std::string& value)
 {
   bool invalid = false;
-  std::istringstream stream(value);
-  int c;
+  Parsing::Cursor cursor(value);
 
   while (true)
   {
-    std::string transfer_coding = Parsing::get_token(stream);
-    if (transfer_coding == "chunked")
+    Parsing::Cursor transfer_coding = Parsing::get_token(cursor);
+    if (transfer_coding.equals("chunked"))
     {
       if (chunked_)
         throw RequestError(400, "Chunked header defined multiple times");
@@ -135,34 +117,33 @@ void Request::validateTransferEncoding(const std::string& value)
         throw RequestError(400, "Chunked must be the last transfer coding");
       invalid = true;
     }
-    Parsing::skip_ows(stream);
+    Parsing::skip_ows(cursor);
     while (true)
     {
-      c = stream.get();
-      if (stream.fail())
+      if (cursor.atEnd())
         return checkInvalid(invalid);
-      Parsing::skip_ows(stream);
+      int c = cursor.get();
+      Parsing::skip_ows(cursor);
       if (c == ',')
       {
-        Parsing::skip_ows(stream);
+        Parsing::skip_ows(cursor);
         break;
       }
       else if (c != ';')
         throw RequestError(400,
                            "Invalid character in Transfer-Encoding header");
-      Parsing::skip_token(stream);
-      Parsing::skip_ows(stream);
-      Parsing::skip_character(stream, '=');
-      Parsing::skip_ows(stream);
-      c = stream.get();
-      if (stream.fail())
+      Parsing::skip_token(cursor);
+      Parsing::skip_ows(cursor);
+      Parsing::skip_character(cursor, '=');
+      Parsing::skip_ows(cursor);
+      if (cursor.atEnd())
         throw RequestError(400, "Transfer-Encoding header stopped too soon");
-      if (c == '\"')
-        Parsing::validateQuotedString(stream);
+      if (cursor.get() == '\"')
+        Parsing::validateQuotedString(cursor);
       else
       {
-        stream.unget();
-        Parsing::skip_token(stream);
+        cursor.unget();
+        Parsing::skip_token(cursor);
       }
       invalid = true;
     }
@@ -181,46 +162,125 @@ void Request::validateContentLength(const std::string& value)
   content_length_ = Option< long >(number);
 }
 
-Option< std::string > Request::getHeader(const std::string& name) const
+/*
+ * Returns NULL if the header wasn't sent
+ */
+const std::string* Request::getHeader(HeaderId id) const
+{
+  return headers_.get(id);
+}
+
+/*
+ * Parses a `bytes=` range set (RFC 9110, 14.1.2). Other units and invalid
+ * syntax make the header get ignored (none), the ranges only get checked
+ * against the file size in FileResponse::applyRanges.
+ */
+Option< VByteRanges > Request::parseRangeHeader(const std::string& value) const
 {
-  std::string lower(name);
-  std::for_each(lower.begin(), lower.end(), Utils::toLower);
+  if (value.compare(0, 6, "bytes=") != 0)
+    return Option< VByteRanges >();
 
-  mHeader::const_iterator it = headers_.find(lower);
-  if (it == headers_.end())
+  VByteRanges ranges;
+  std::istringstream stream(value.substr(6));
+  std::string spec;
+  while (std::getline(stream, spec, ','))
   {
-    return Option< std::string >();
+    spec = Utils::trimString(spec);
+    if (spec.empty())
+      continue;
+    std::string::size_type dash = spec.find('-');
+    if (dash == std::string::npos)
+      return Option< VByteRanges >();
+
+    ByteRange range;
+    if (!parseRangePosition(spec.substr(0, dash), range.first) ||
+        !parseRangePosition(spec.substr(dash + 1), range.last) ||
+        (range.first == -1 && range.last == -1) ||
+        (range.first != -1 && range.last != -1 && range.last < range.first))
+      return Option< VByteRanges >();
+    ranges.push_back(range);
+    if (ranges.size() > RANGES_MAX)
+      return Option< VByteRanges >();
   }
 
-  return Option< std::string >(it->second);
+  if (ranges.empty())
+    return Option< VByteRanges >();
+  return Option< VByteRanges >(ranges);
 }
 
-void Request::processConnectionHeader(void)
+/*
+ * Whether Accept-Encoding allows `coding` (RFC 9110, 12.5.3). An explicit
+ * entry wins over "*", a qvalue of 0 means "not acceptable".
+ */
+bool Request::acceptsEncoding(const std::string& coding) const
 {
-  Option< std::string > header = getHeader("Connection");
-  if (header.is_none())
-    return;
+  const std::string* header = getHeader(HEADER_ACCEPT_ENCODING);
+  if (!header)
+    return false;
 
-  std::string value = header.unwrap();
+  std::string value = *header;
   std::for_each(value.begin(), value.end(), Utils::toLower);
-
   std::istringstream stream(value);
-  int c;
+  std::string entry;
+  bool wildcard = false;
+  while (std::getline(stream, entry, ','))
+  {
+    std::string::size_type semicolon = entry.find(';');
+    std::string name = Utils::trimString(entry.substr(0, semicolon));
+    bool accepted = true;
+    if (semicolon != std::string::npos)
+    {
+      std::string::size_type q = entry.find("q=", semicolon);
+      if (q != std::string::npos)
+        accepted = std::strtod(entry.c_str() + q + 2, NULL) > 0;
+    }
+    if (name == coding || (coding == "gzip" && name == "x-gzip"))
+      return accepted;
+    if (name == "*")
+      wildcard = accepted;
+  }
+  return wildcard;
+}
+
+/*
+ * An empty position is valid and stored as -1
+ */
+static bool parseRangePosition(const std::string& str, off_t& position)
+{
+  position = -1;
+  if (str.empty())
+    return true;
+  if (str.size() > 18 ||
+      str.find_first_not_of("0123456789") != std::string::npos)
+    return false;
+
+  position = 0;
+  for (std::string::size_type i = 0; i < str.size(); ++i)
+    position = position * 10 + (str[i] - '0');
+  return true;
+}
+
+void Request::processConnectionHeader(void)
+{
+  const std::string* header = getHeader(HEADER_CONNECTION);
+  if (!header)
+    return;
+
+  Parsing::Cursor cursor(*header);
 
   while (true)
   {
-    std::string part = Parsing::get_token(stream);
+    Parsing::Cursor part = Parsing::get_token(cursor);
     // Ignore everything except close and keep-alive
-    if (part == "close")
+    if (part.equalsIgnoreCase("close"))
       closing_ = true;
-    else if (part == "keep-alive")
+    else if (part.equalsIgnoreCase("keep-alive"))
       closing_ = false;
-    Parsing::skip_ows(stream);
-    c = stream.get();
-    if (stream.fail())
+    Parsing::skip_ows(cursor);
+    if (cursor.atEnd())
       break;
-    if (c != ',')
+    if (cursor.get() != ',')
       throw RequestError(400, "Invalid character in Connection header");
-    Parsing::skip_ows(stream);
+    Parsing::skip_ows(cursor);
   }
 }
@@ -11,4 +11,6 @@ struct PathInfos
   bool writable;
   bool executable;
   off_t size;
+  time_t mtime;
+  ino_t inode;
 };
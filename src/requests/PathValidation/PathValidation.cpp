@@ -25,6 +25,8 @@ PathInfos getFileType(const std::string& filename)
       infos.writable = false;
       infos.executable = false;
       infos.size = -1;
+      infos.mtime = 0;
+      infos.inode = 0;
       return (infos);
     }
     else if (errno == ENOTDIR)
@@ -51,6 +53,8 @@ PathInfos getFileType(const std::string& filename)
   infos.writable = fileWritable(filename);
   infos.executable = fileExecutable(filename);
   infos.size = statbuf.st_size;
+  infos.mtime = statbuf.st_mtime;
+  infos.inode = statbuf.st_ino;
   return (infos);
 }
 
@@ -17,6 +17,8 @@
 #include <cstdlib>
 #include <string>
 #include "../Configs/Configs.hpp"
+#include "../cache/FileCache.hpp"
+#include "../cache/OpenFileCache.hpp"
 #include "../exceptions/RequestError.hpp"
 #include "../responses/CgiResponse.hpp"
 #include "../responses/RedirectResponse.hpp"
@@ -50,6 +52,8 @@ void Request::uploadBody(const std::string& body, UploadMode mode)
     status_ = READING_START_LINE;
     return;
   }
+  if (response_)
+    return streamBody(body, mode);
   if (!upload_file_.is_open())
     throw RequestError(500, "Upload file not open");
   if (mode == ERROR_LENGTH)
@@ -82,10 +86,6 @@ void Request::uploadBody(const std::string& body, UploadMode mode)
     {
       if (current_upload_files_.erase(absolute_path_) == 0)
         throw RequestError(500, "File not found in current uploads");
-      std::string cgi_bin_path;
-      cgi_extension_ == PHP
-          ? cgi_bin_path = Configuration::getInstance().getPhpPath()
-          : cgi_bin_path = Configuration::getInstance().getPythonPath();
       std::string method_str;
       switch (method_)
       {
@@ -102,13 +102,7 @@ void Request::uploadBody(const std::string& body, UploadMode mode)
           break;
       }
       upload_file_.close();
-      std::string cookies;
-      if (getHeader("cookie").is_some())
-        cookies = getHeader("cookie").unwrap();
-      else
-        cookies = "";
-      CgiVars cgi_vars = createCgiVars();
-      response_ = new CgiResponse(fd_, closing_, cgi_bin_path, cgi_vars);
+      response_ = createCgiResponse();
       status_ = SENDING_RESPONSE;
       return;
     }
@@ -125,8 +119,30 @@ void Request::uploadBody(const std::string& body, UploadMode mode)
       response_ =
           new StaticResponse(fd_, 200, closing_, "", additional_headers);
     upload_file_.close();
+    getOpenFileCache().invalidate(absolute_path_);
+    getFileCache().invalidate(absolute_path_);
+    getGzipCache().invalidate(absolute_path_);
     if (current_upload_files_.erase(absolute_path_) == 0)
       throw RequestError(500, "File not found in current uploads");
     status_ = SENDING_RESPONSE;
   }
 }
+
+/*
+ * The CGI is running already (see Request::setupCgiStream), the body goes
+ * straight to its stdin. Its output is sent while the body still comes in
+ * (see Connection::sendWhileStreaming).
+ */
+void Request::streamBody(const std::string& body, UploadMode mode)
+{
+  if (mode == ERROR_LENGTH)
+    throw RequestError(413, "Request body too large");
+  if (mode == ERROR_CHUNKSIZE)
+    throw RequestError(400, "Invalid chunk size");
+
+  CgiResponse* response = static_cast< CgiResponse* >(response_);
+  response->writeBody(body, mode == END);
+  total_written_bytes_ += body.size();
+  if (mode == END)
+    status_ = SENDING_RESPONSE;
+}
@@ -8,9 +8,13 @@
 #include <cerrno>
 #include <cstddef>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include "../CgiPool.hpp"
 #include "../Configs/Configs.hpp"
+#include "../cache/FileCache.hpp"
+#include "../cache/OpenFileCache.hpp"
 #include "../epoll/EpollData.hpp"
 #include "../exceptions/ConError.hpp"
 #include "../exceptions/ExitExc.hpp"
@@ -21,6 +25,7 @@
 #include "../responses/FileResponse.hpp"
 #include "../responses/RedirectResponse.hpp"
 #include "../responses/StaticResponse.hpp"
+#include "../utils/Gzip.hpp"
 #include "../utils/Utils.hpp"
 #include "PathValidation/FileTypes.hpp"
 #include "PathValidation/PathInfos.hpp"
@@ -28,10 +33,13 @@
 #include "RequestMethods.hpp"
 #include "RequestStatus.hpp"
 
+static bool isFreshSibling(const std::string& path,
+                           const std::string& sibling);
+
 std::set< std::string > Request::current_upload_files_;
 
 Request::Request(const int fd,
-                 const std::vector< Server >& servers,
+                 const VirtualHosts& servers,
                  const std::string& client_ip)
     : fd_(fd),
       client_ip_(client_ip),
@@ -46,6 +54,7 @@ Request::Request(const int fd,
       response_(NULL),
       is_cgi_(false),
       file_existed_(false),
+      fastcgi_pass_(NULL),
       total_written_bytes_(0)
 {}
 
@@ -72,6 +81,7 @@ Request::Request(const Request& other)
       is_cgi_(other.is_cgi_),
       filename_(other.filename_),
       file_existed_(other.file_existed_),
+      fastcgi_pass_(other.fastcgi_pass_),
       total_written_bytes_(other.total_written_bytes_)
 {}
 
@@ -102,6 +112,7 @@ Request& Request::operator=(const Request& other)
     response_ = other.response_;
     is_cgi_ = other.is_cgi_;
     file_existed_ = other.file_existed_;
+    fastcgi_pass_ = other.fastcgi_pass_;
     total_written_bytes_ = other.total_written_bytes_;
   }
   filename_ = other.filename_;
@@ -135,22 +146,21 @@ Request::~Request()
   }
 }
 
-void Request::addHeaderLine(const std::string& line)
+void Request::addHeaderLine(const char* line, size_t length)
 {
-  size_t pos = line.find('\r');
-  if (pos != std::string::npos)
+  if (std::memchr(line, '\r', length))
     throw RequestError(400, "Unexpected CR before end of header line");
 
-  total_header_size_ += line.size();
+  total_header_size_ += length;
   if (total_header_size_ > 32768)
     throw RequestError(400, "Total header size too large");
 
   switch (status_)
   {
     case READING_START_LINE:
-      return readStartLine(line);
+      return readStartLine(line, length);
     case READING_HEADERS:
-      return processHeaderLine(line);
+      return processHeaderLine(line, length);
     default:
       // In any other case it should not go here
       throw;
@@ -162,6 +172,8 @@ void Request::sendResponse()
   try
   {
     response_->sendResponse();
+    if (status_ == READING_BODY)
+      return;  // Still streaming the body, see Connection::sendWhileStreaming
     if (response_->isComplete())
     {
       status_ = COMPLETED;
@@ -170,7 +182,7 @@ void Request::sendResponse()
     else if (response_->isCgiAndEmpty())
     {
       EpollData& ep_data = getEpollData();
-      EpollFd* fd = ep_data.fds[fd_];
+      EpollFd* fd = ep_data.fds.find(fd_);
       struct epoll_event* event = fd->getEvent();
       event->events = 0;
       if (epoll_ctl(ep_data.fd, EPOLL_CTL_MOD, fd_, event) == -1)
@@ -180,22 +192,49 @@ void Request::sendResponse()
   catch (RequestError& e)
   {
     std::cerr << e.what() << std::endl;
-    delete response_;
-    response_ = new StaticResponse(fd_, 500, true);
+    setResponse(new StaticResponse(fd_, 500, true));
   }
   catch (ExitExc& e)
   {
     std::cerr << e.what() << std::endl;
-    delete response_;
-    response_ = new StaticResponse(fd_, 500, true);
+    setResponse(new StaticResponse(fd_, 500, true));
   }
 }
 
+/*
+ * Moves the output of the response to `queue` if it's completely buffered
+ * already, see Response::takeOutput
+ */
+bool Request::takeOutput(OutputQueue& queue)
+{
+  if (!response_ || !response_->takeOutput(queue))
+    return false;
+  status_ = COMPLETED;
+  closing_ = response_->getClosing();
+  return true;
+}
+
 RequestStatus Request::getStatus() const
 {
   return status_;
 }
 
+/*
+ * The body is still streamed to a CGI that already runs, see setupCgiStream()
+ */
+bool Request::streamingBody() const
+{
+  return status_ == READING_BODY && response_;
+}
+
+/*
+ * The response has output that can be sent right away
+ */
+bool Request::hasOutput() const
+{
+  return response_ && !response_->isComplete() && !response_->isCgiAndEmpty();
+}
+
 const std::string& Request::getStartLine() const
 {
   return startline_;
@@ -218,7 +257,7 @@ void Request::processRequest(void)
 {
   const Server& server = getServer(host_);
   server_ = &server;
-  const Location& location = findMatchingLocationBlock(server.locations, path_);
+  const Location& location = findMatchingLocationBlock(server, path_);
 
   processConnectionHeader();
 
@@ -246,7 +285,8 @@ void Request::processRequest(void)
   splitPathInfo(location);
   if (path_[path_.length() - 1] != '/')
   {
-    PathInfos infos = getFileType(location.root + "/" + path_);
+    PathInfos infos =
+        getOpenFileCache().getFileType(location.root + "/" + path_);
     if (infos.exists && infos.types == DIRECTORY)
     {
       string url = "http://" + host_;
@@ -263,10 +303,12 @@ void Request::processRequest(void)
   else
     max_body_size_ = 1024 * 1024;  // Default max body size
   checkForCgi(location);
+  if (location.fastcgi_pass.configured())
+    fastcgi_pass_ = &location.fastcgi_pass;
   bool is_upload = isFileUpload(location);
   if (is_cgi_)
   {
-    PathInfos infos = getFileType(cgi_script_filename_);
+    PathInfos infos = getOpenFileCache().getFileType(cgi_script_filename_);
     if (!infos.exists || infos.types != REGULAR_FILE)
       throw RequestError(404, "CGI Skript not found");
     // PathInfos
@@ -274,20 +316,17 @@ void Request::processRequest(void)
   if (is_upload && is_cgi_ == false)
     return (setupFileUpload());
   else if (is_upload && is_cgi_ == true)
+  {
+    if (streamsCgiBody(location))
+      return (setupCgiStream());
     return (setupCgi());
+  }
   else if (is_cgi_)
   {
-    CgiVars cgi_vars = createCgiVars();
-    std::string cgi_bin_path;
-    cgi_extension_ == PHP
-        ? cgi_bin_path = Configuration::getInstance().getPhpPath()
-        : cgi_bin_path = Configuration::getInstance().getPythonPath();
-    std::string cookies;
-    if (getHeader("cookie").is_some())
-      cookies = getHeader("cookie").unwrap();
-    else
-      cookies = "";
-    response_ = new CgiResponse(fd_, closing_, cgi_bin_path, cgi_vars);
+    CgiResponse* response = createCgiResponse();
+    if (acceptsEncoding("gzip"))
+      response->allowGzip();
+    response_ = response;
     status_ = SENDING_RESPONSE;
     return;
   }
@@ -298,7 +337,7 @@ void Request::processRequest(void)
 
 void Request::processFilePath(const std::string& path, const Location& location)
 {
-  PathInfos infos = getFileType(path);
+  PathInfos infos = getOpenFileCache().getFileType(path);
   if (current_upload_files_.find(path) != current_upload_files_.end())
     throw RequestError(409, "Conflict: File being uploaded");
   if (!infos.exists)
@@ -310,9 +349,12 @@ void Request::processFilePath(const std::string& path, const Location& location)
   else if (infos.types == REGULAR_FILE)
   {
     if (method_ == GET)
-      setResponse(new FileResponse(fd_, path, 200, closing_));
+      setFileResponse(path, location);
     else if (method_ == DELETE)
     {
+      getOpenFileCache().invalidate(path);
+      getFileCache().invalidate(path);
+      getGzipCache().invalidate(path);
       if (std::remove(path.c_str()) == 0)
         setResponse(new StaticResponse(fd_, 204, false, ""));
       else
@@ -350,7 +392,7 @@ void Request::openDirectory(const std::string& path, const Location& location)
 
   for (it = files.begin(); it != files.end(); ++it)
   {
-    PathInfos infos = getFileType(path + *it);
+    PathInfos infos = getOpenFileCache().getFileType(path + *it);
     if (!infos.exists)
       continue;
     if (!infos.readable || infos.types == OTHER)
@@ -366,7 +408,7 @@ void Request::openDirectory(const std::string& path, const Location& location)
     }
     else
     {
-      setResponse(new FileResponse(fd_, path + *it, 200, closing_));
+      setFileResponse(path + *it, location);
       return;
     }
   }
@@ -382,7 +424,77 @@ void Request::createDirectoryListing(const std::string& path)
   close(fd);
 
   std::string content = DirectoryListing::createDirectoryListing(path, path_);
-  setResponse(new StaticResponse(fd_, 200, closing_, content));
+  std::map< std::string, std::string > headers;
+  const GzipSettings& gzip = Configuration::getInstance().getGzipSettings();
+  if (gzip.compresses("text/html"))
+  {
+    headers["Vary"] = "Accept-Encoding";
+    if (content.size() >= gzip.min_length && acceptsEncoding("gzip"))
+    {
+      content = Utils::gzip(content);
+      headers["Content-Encoding"] = "gzip";
+    }
+  }
+  setResponse(new StaticResponse(fd_, 200, closing_, content, headers));
+}
+
+void Request::setFileResponse(const std::string& path,
+                              const Location& location)
+{
+  std::string encoding;
+  std::string file = findPrecompressed(path, location, encoding);
+  FileResponse* response =
+      new FileResponse(fd_, file, 200, closing_, encoding);
+  setResponse(response);
+  if (location.gzip_static.first || location.brotli_static.first)
+    response->setVary();
+  if (method_ != GET)
+    return;
+
+  response->compress(file, acceptsEncoding("gzip"));
+  response->evaluateConditions(getHeader(HEADER_IF_NONE_MATCH),
+                               getHeader(HEADER_IF_MODIFIED_SINCE));
+  const std::string* range = getHeader(HEADER_RANGE);
+  if (!range)
+    return;
+  Option< VByteRanges > ranges = parseRangeHeader(*range);
+  if (ranges.is_some())
+    response->applyRanges(ranges.unwrap(), getHeader(HEADER_IF_RANGE));
+}
+
+/*
+ * Picks the `.br` or `.gz` sibling of `path` if the location allows it, the
+ * client accepts that encoding and the sibling isn't older than the original
+ * file. Returns `path` itself otherwise.
+ */
+std::string Request::findPrecompressed(const std::string& path,
+                                       const Location& location,
+                                       std::string& encoding) const
+{
+  if (method_ != GET)
+    return path;
+
+  if (location.brotli_static.first && acceptsEncoding("br") &&
+      isFreshSibling(path, path + ".br"))
+  {
+    encoding = "br";
+    return path + ".br";
+  }
+  if (location.gzip_static.first && acceptsEncoding("gzip") &&
+      isFreshSibling(path, path + ".gz"))
+  {
+    encoding = "gzip";
+    return path + ".gz";
+  }
+  return path;
+}
+
+static bool isFreshSibling(const std::string& path, const std::string& sibling)
+{
+  PathInfos infos = getOpenFileCache().getFileType(sibling);
+  if (!infos.exists || infos.types != REGULAR_FILE || !infos.readable)
+    return false;
+  return infos.mtime >= getOpenFileCache().getFileType(path).mtime;
 }
 
 bool Request::closingConnection() const
@@ -402,15 +514,7 @@ void Request::setResponse(Response* response)
 
 const Server& Request::getServer(const std::string& host) const
 {
-  vServer::const_iterator server;
-
-  for (server = servers_.begin(); server != servers_.end(); ++server)
-  {
-    if (server->server_names.find(host) != server->server_names.end())
-      return *server;
-  }
-
-  return servers_.front();
+  return servers_.find(host);
 }
 
 bool Request::isChunked() const
@@ -440,24 +544,14 @@ bool Request::methodAllowed(const Location& location) const
   }
 }
 
-const Location& Request::findMatchingLocationBlock(const MLocations& locations,
+const Location& Request::findMatchingLocationBlock(const Server& server,
                                                    const std::string& path)
 {
-  MLocations::const_iterator it;
-
-  it = locations.find(path);
-  if (it != locations.end())
-    return it->second;
+  const Location* location = server.location_trie.find(path);
 
-  for (it = locations.begin(); it != locations.end(); ++it)
-  {
-    if (*it->first.rbegin() == '/' &&
-        path.substr(0, it->first.length()) == it->first)
-    {
-      return it->second;
-    }
-  }
-  throw RequestError(404, "No matching location found");
+  if (!location)
+    throw RequestError(404, "No matching location found");
+  return *location;
 }
 
 void Request::checkForCgi(const Location& loc)
@@ -478,7 +572,8 @@ void Request::checkForCgi(const Location& loc)
       if (loc.root[loc.root.length() - 1] != '/' && skriptname[0] != '/')
         optional_slash = "/";
       string filename = loc.root + optional_slash + skriptname + *it;
-      PathInfos infos = getFileType(filename);  // Check if default file exists
+      // Check if default file exists
+      PathInfos infos = getOpenFileCache().getFileType(filename);
       if (infos.exists == true && infos.types == REGULAR_FILE &&
           infos.readable == true)
       {
@@ -514,8 +609,9 @@ void Request::checkForCgi(const Location& loc)
     if (!file_extension.empty() &&
         loc.cgi_extensions.find(file_extension) != loc.cgi_extensions.end())
     {
+      // Check if skript exists
       PathInfos infos =
-          getFileType(loc.root + "/" + skriptname);  // Check if skript exists
+          getOpenFileCache().getFileType(loc.root + "/" + skriptname);
       if (!infos.exists || infos.types != REGULAR_FILE || !infos.readable)
         throw RequestError(404, "CGI Skript not found");
       is_cgi_ = true;
@@ -625,6 +721,9 @@ void Request::setupFileUpload()
   if (current_upload_files_.insert(absolute_path_).second)
   {
     errno = 0;  // Reset errno before opening the file
+    getOpenFileCache().invalidate(absolute_path_);
+    getFileCache().invalidate(absolute_path_);
+    getGzipCache().invalidate(absolute_path_);
     upload_file_.open(absolute_path_.c_str(),
                       O_CREAT | O_TRUNC | O_CLOEXEC | O_WRONLY);
     if (errno == ENAMETOOLONG)
@@ -659,6 +758,63 @@ void Request::setupCgi()
   status_ = READING_BODY;
 }
 
+/*
+ * With `cgi_request_buffering off` the body goes to the script through a pipe
+ * while it's still coming in. That needs the length up front (CONTENT_LENGTH)
+ * and a process of its own, everything else is staged in a temporary file
+ * first, which is also what scripts that seek in their stdin need.
+ */
+bool Request::streamsCgiBody(const Location& loc) const
+{
+  if (loc.request_buffering.first || chunked_ || content_length_.is_none() ||
+      fastcgi_pass_)
+    return false;
+  return !(cgi_extension_ == PHP ? getPhpPool() : getPythonPool()).enabled();
+}
+
+/*
+ * Starts the script right away, the body is handed to it by uploadBody()
+ */
+void Request::setupCgiStream()
+{
+  long length = content_length_.unwrap();
+  if (length > max_body_size_)
+    throw RequestError(413, "Request body too large");
+
+  CgiVars cgi_vars = createCgiVars();
+  cgi_vars.input_streamed = true;
+  cgi_vars.file_size = length;
+  CgiResponse* response =
+      new CgiResponse(fd_, closing_, getCgiBinPath(), cgi_vars);
+  if (acceptsEncoding("gzip"))
+    response->allowGzip();
+  response_ = response;
+  total_written_bytes_ = 0;
+  status_ = READING_BODY;
+}
+
+/*
+ * Scripts of a location with `fastcgi_pass` go to the FastCGI server, all
+ * others get an interpreter process of their own
+ */
+CgiResponse* Request::createCgiResponse(void) const
+{
+  CgiVars cgi_vars = createCgiVars();
+  if (fastcgi_pass_)
+    return new CgiResponse(fd_, closing_, *fastcgi_pass_, cgi_vars);
+  CgiPool& pool = cgi_extension_ == PHP ? getPhpPool() : getPythonPool();
+  if (pool.enabled())
+    return new CgiResponse(fd_, closing_, pool, cgi_vars);
+  return new CgiResponse(fd_, closing_, getCgiBinPath(), cgi_vars);
+}
+
+std::string Request::getCgiBinPath(void) const
+{
+  if (cgi_extension_ == PHP)
+    return Configuration::getInstance().getPhpPath();
+  return Configuration::getInstance().getPythonPath();
+}
+
 const Server& Request::getServer() const
 {
   if (server_ == NULL)
@@ -674,9 +830,10 @@ long Request::getMaxBodySize() const
 CgiVars Request::createCgiVars(void) const
 {
   CgiVars cgi_vars;
-  mHeader::const_iterator it;
+  VHeaderFields::const_iterator it;
 
   cgi_vars.input_file = absolute_path_;
+  cgi_vars.input_streamed = false;
   cgi_vars.file_size = total_written_bytes_;
   cgi_vars.request_method_enum_ = method_;
   cgi_vars.request_method_str = methodToString(method_);
@@ -690,16 +847,17 @@ CgiVars Request::createCgiVars(void) const
   cgi_vars.query_string = query_string_;
   cgi_vars.document_root = document_root_;
 
-  for (it = headers_.begin(); it != headers_.end(); ++it)
+  const VHeaderFields& fields = headers_.fields();
+  for (it = fields.begin(); it != fields.end(); ++it)
   {
-    if (it->first == "content-type")
-      cgi_vars.content_type = it->second;
-    else if (it->first != "content-length" &&
-             it->first != "transfer-encoding" && it->first != "connection")
+    if (it->id == HEADER_CONTENT_TYPE)
+      cgi_vars.content_type = it->value;
+    else if (it->id != HEADER_CONTENT_LENGTH &&
+             it->id != HEADER_TRANSFER_ENCODING && it->id != HEADER_CONNECTION)
     {
-      std::string key = it->first;
-      std::for_each(key.begin(), key.end(), Utils::toUpperWithUnderscores);
-      cgi_vars.headers["HTTP_" + key] = it->second;
+      std::string key = "HTTP_" + it->name;
+      std::for_each(key.begin() + 5, key.end(), Utils::toUpperWithUnderscores);
+      cgi_vars.headers[key] = it->value;
     }
   }
 
@@ -737,7 +895,7 @@ void Request::splitPathInfo(const Location& location)
     std::string path =
         location.root +
         path_.substr(0, *it).substr(location.location_name.find_last_of('/'));
-    PathInfos infos = getFileType(path);
+    PathInfos infos = getOpenFileCache().getFileType(path);
     if (infos.exists && infos.types == REGULAR_FILE)
     {
       path_info_ = path_.substr(*it);
@@ -2,23 +2,20 @@
 
 #include <sys/types.h>
 #include <map>
-#include <sstream>
 #include <string>
 #include <vector>
 #include "../Configs/Configs.hpp"
+#include "../Configs/VirtualHosts.hpp"
 #include "../Option.hpp"
+#include "../parsing/Parsing.hpp"
 #include "../responses/Response.hpp"
 #include "../utils/FdWrap.hpp"
+#include "ByteRanges.hpp"
 #include "CgiVars.hpp"
+#include "HeaderFields.hpp"
 #include "RequestMethods.hpp"
 #include "RequestStatus.hpp"
 
-typedef std::map< std::string, std::string > mHeader;
-typedef std::vector< Server > vServer;
-
-const static std::string STANDARD_HEADERS[] = {"host", "content-length",
-                                               "transfer-encoding"};
-
 enum UploadMode
 {
   NORM,
@@ -36,6 +33,8 @@ enum CgiExtension
   PYTHON
 };
 
+class CgiResponse;
+
 class Request
 {
   // ── ◼︎ member variables
@@ -53,11 +52,11 @@ class Request
   std::string port_;
   std::string startline_;
   std::string query_string_;
-  mHeader headers_;
+  HeaderFields headers_;
   bool chunked_;
   Option< long > content_length_;
   bool closing_;
-  const vServer& servers_;
+  const VirtualHosts& servers_;
   size_t total_header_size_;
   Response* response_;
 
@@ -65,7 +64,7 @@ class Request
   // ───────────────────────
  public:
   Request(int fd,
-          const std::vector< Server >& servers,
+          const VirtualHosts& servers,
           const std::string& client_ip);
   Request(const Request& other);
   Request& operator=(const Request& other);
@@ -73,13 +72,17 @@ class Request
 
   // ── ◼︎ Request
   // ───────────────────────
-  void addHeaderLine(const std::string& line);
+  void addHeaderLine(const char* line, size_t length);
   void processRequest(void);
 
  private:
   bool isFileUpload(const Location& loc);
   void setupFileUpload();
   void setupCgi();
+  bool streamsCgiBody(const Location& loc) const;
+  void setupCgiStream();
+  CgiResponse* createCgiResponse(void) const;
+  std::string getCgiBinPath(void) const;
 
   std::string generateRandomFilename();
   // ── ◼︎ POST
@@ -88,6 +91,8 @@ class Request
   void uploadBody(const std::string& body, UploadMode mode = NORM);
 
  private:
+  void streamBody(const std::string& body, UploadMode mode);
+
   long max_body_size_;
   bool is_cgi_;
   std::string filename_;
@@ -99,17 +104,21 @@ class Request
   bool file_existed_;
   static std::set< std::string > current_upload_files_;
   CgiExtension cgi_extension_;
+  const FastCgiAddress* fastcgi_pass_;  // NULL if the CGI runs as a process
   long total_written_bytes_;
   std::string upload_dir_;
   // ── ◼︎ Response
   // ───────────────────────
  public:
   void sendResponse();
+  bool takeOutput(OutputQueue& queue);
   void setResponse(Response* response);
 
   // ── ◼︎ getters
   // ───────────────────────
   RequestStatus getStatus() const;
+  bool streamingBody() const;
+  bool hasOutput() const;
   bool closingConnection() const;
   const Server& getServer() const;
   const std::string& getStartLine() const;
@@ -121,23 +130,25 @@ class Request
 
   // ── ◼︎ utils
   // ────────────────────────────────────────────────────────
-  static const Location& findMatchingLocationBlock(const MLocations& locations,
+  static const Location& findMatchingLocationBlock(const Server& server,
                                                    const std::string& path);
 
   // ── ◼︎ Start Line
   // ───────────────────────
-  void readStartLine(const std::string& line);
-  void parseMethod(std::istringstream& stream);
-  void parsePath(std::istringstream& stream);
+  void readStartLine(const char* line, size_t length);
+  void parseMethod(Parsing::Cursor& cursor);
+  void parsePath(Parsing::Cursor& cursor);
   void parseAbsoluteForm(const std::string& path);
 
   // ── ◼︎ Header
   // ───────────────────────
-  Option< std::string > getHeader(const std::string& name) const;
-  void processHeaderLine(const std::string& line);
-  void insertHeader(const std::string& key, const std::string& value);
+  const std::string* getHeader(HeaderId id) const;
+  void processHeaderLine(const char* line, size_t length);
+  void insertHeader(std::string& key, std::string& value);
   void validateHeaders(void);
   void processConnectionHeader(void);
+  Option< VByteRanges > parseRangeHeader(const std::string& value) const;
+  bool acceptsEncoding(const std::string& coding) const;
 
   // ── ◼︎ Random stuff
   // ───────────────────────
@@ -145,6 +156,10 @@ class Request
   void processFilePath(const std::string& path, const Location& location);
   int openFile(const std::string& path) const;
   void openDirectory(const std::string& path, const Location& location);
+  void setFileResponse(const std::string& path, const Location& location);
+  std::string findPrecompressed(const std::string& path,
+                                const Location& location,
+                                std::string& encoding) const;
   void createDirectoryListing(const std::string& path);
   const Server& getServer(const std::string& host) const;
   bool methodAllowed(const Location& location) const;
@@ -1,5 +1,6 @@
 #include <sys/types.h>
 #include <cctype>
+#include <cstring>
 #include <sstream>
 #include <string>
 #include "../exceptions/RequestError.hpp"
@@ -7,63 +8,68 @@
 #include "Request.hpp"
 #include "RequestStatus.hpp"
 
-static void parseHTTPVersion(std::istringstream& stream);
+static void parseHTTPVersion(Parsing::Cursor& cursor);
 
-void Request::readStartLine(const std::string& line)
+/*
+ * `line` still points into the connection buffer, only the parts that are
+ * kept (start line, target, path and query) get copied
+ */
+void Request::readStartLine(const char* line, size_t length)
 {
-  if (line.empty())
+  if (length == 0)
     return;
-  startline_ = line;
+  startline_.assign(line, length);
 
-  std::istringstream stream(line);
+  Parsing::Cursor cursor(line, line + length);
 
-  parseMethod(stream);
-  Parsing::skip_character(stream, ' ');
-  std::istringstream::pos_type start_pos = stream.tellg();
-  parsePath(stream);
-  std::istringstream::pos_type end_pos = stream.tellg();
-  uri_ = line.substr(start_pos, end_pos - start_pos);
-  Parsing::skip_character(stream, ' ');
-  parseHTTPVersion(stream);
+  parseMethod(cursor);
+  Parsing::skip_character(cursor, ' ');
+  const char* target = cursor.pos;
+  parsePath(cursor);
+  uri_.assign(target, cursor.pos);
+  Parsing::skip_character(cursor, ' ');
+  parseHTTPVersion(cursor);
 
   status_ = READING_HEADERS;
 }
 
-void Request::parseMethod(std::istringstream& stream)
+void Request::parseMethod(Parsing::Cursor& cursor)
 {
-  std::string method;
+  Parsing::Cursor method = Parsing::get_token(cursor);
 
-  method = Parsing::get_token(stream);
-
-  if (method == "GET")
+  if (method.equals("GET"))
     method_ = GET;
-  else if (method == "POST")
+  else if (method.equals("POST"))
     method_ = POST;
-  else if (method == "DELETE")
+  else if (method.equals("DELETE"))
     method_ = DELETE;
   else
     method_ = INVALID;
 }
 
-void Request::parsePath(std::istringstream& stream)
+void Request::parsePath(Parsing::Cursor& cursor)
 {
-  std::string::iterator it;
-  std::string::size_type pos;
+  const char* space =
+      static_cast< const char* >(std::memchr(cursor.pos, ' ', cursor.size()));
+  Parsing::Cursor path(cursor.pos, space ? space : cursor.end);
 
-  if (!(stream >> std::noskipws >> path_))
+  if (path.atEnd())
     throw RequestError(400, "Unable to parse path");
-  pos = path_.find('?');
-  if (pos != std::string::npos)
+  cursor.pos = path.end;
+
+  const char* question_mark =
+      static_cast< const char* >(std::memchr(path.pos, '?', path.size()));
+  if (question_mark)
   {
-    query_string_ = path_.substr(pos + 1);
-    query_string_ = Parsing::processQueryString(query_string_);
-    path_ = path_.substr(0, pos);
+    Parsing::processQueryString(Parsing::Cursor(question_mark + 1, path.end),
+                                query_string_);
+    path.end = question_mark;
   }
 
-  if (path_[0] != '/')
-    parseAbsoluteForm(path_);
+  if (path.atEnd() || path.peek() != '/')
+    parseAbsoluteForm(path.str());
   else
-    path_ = Parsing::processPath(path_);
+    Parsing::processPath(path, path_);
 }
 
 void Request::parseAbsoluteForm(const std::string& abs_path)
@@ -90,7 +96,7 @@ void Request::parseAbsoluteForm(const std::string& abs_path)
   if (pos != std::string::npos)
   {
     host_ = path.substr(0, pos);
-    path_ = Parsing::processPath(path.substr(pos));
+    Parsing::processPath(path.substr(pos), path_);
   }
   else
   {
@@ -105,24 +111,25 @@ void Request::parseAbsoluteForm(const std::string& abs_path)
   port_ = ss.str();
 }
 
-static void parseHTTPVersion(std::istringstream& stream)
+/*
+ * Only "HTTP/1.1" is accepted, but any other well-formed version gets a 505
+ * instead of a 400
+ */
+static void parseHTTPVersion(Parsing::Cursor& cursor)
 {
-  std::string version;
+  const char* version = cursor.pos;
 
-  if (!(stream >> version))
+  if (cursor.atEnd())
     throw RequestError(400, "Unable to parse HTTP version");
 
-  if (version.length() != 8 || version.substr(0, 5) != "HTTP/" ||
-      version[6] != '.' || !std::isdigit(version[5]) ||
-      !std::isdigit(version[7]))
+  if (cursor.size() != 8 || std::memcmp(version, "HTTP/", 5) != 0 ||
+      version[6] != '.' ||
+      !std::isdigit(static_cast< unsigned char >(version[5])) ||
+      !std::isdigit(static_cast< unsigned char >(version[7])))
   {
     throw RequestError(400, "Malformed HTTP version");
   }
 
-  stream.get();
-  if (!stream.fail())
-    throw RequestError(400, "Unexpected content after HTTP version");
-
-  if (version != "HTTP/1.1")
+  if (std::memcmp(version + 5, "1.1", 3) != 0)
     throw RequestError(505, "Invalid HTTP version");
 }
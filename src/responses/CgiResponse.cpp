@@ -3,12 +3,18 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <exception>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include "../CgiPool.hpp"
 #include "../Configs/Configs.hpp"
+#include "../epoll/BodyPipe.hpp"
+#include "../epoll/Connection.hpp"
+#include "../epoll/EpollData.hpp"
+#include "../epoll/FastCgiConnection.hpp"
 #include "../epoll/PipeFd.hpp"
 #include "../exceptions/ConError.hpp"
 #include "../exceptions/ExitExc.hpp"
@@ -21,40 +27,150 @@ CgiResponse::CgiResponse(int client_fd,
                          const std::string& cgi_path,
                          const CgiVars& cgi_vars)
     : Response(client_fd, 200, close),
+      pipe_fd_(NULL),
+      body_pipe_(NULL),
+      fastcgi_(NULL),
+      fastcgi_id_(0),
+      pool_(NULL),
+      pool_worker_(-1),
       headers_created_(false),
       status_found_(false),
       meta_variables_(NULL),
       cgi_vars_(cgi_vars),
-      cgi_path_(cgi_path),
-      last_chunk_sent_(false)
+      last_chunk_sent_(false),
+      gzip_allowed_(false),
+      gzip_(NULL)
 {
   meta_variables_ = implementMetaVariables();
 
   try
   {
-    pipe_fd_ = new PipeFd(full_response_, cgi_vars.script_filename, cgi_path,
-                          cgi_vars.input_file, this, meta_variables_,
-                          cgi_vars.request_method_enum_);
+    if (cgi_vars.input_streamed)
+      body_pipe_ = new BodyPipe(this);
+    pipe_fd_ = new PipeFd(cgi_vars.script_filename, cgi_path,
+                          cgi_vars.input_file,
+                          body_pipe_ ? body_pipe_->getReadEnd() : -1, this,
+                          meta_variables_, cgi_vars.request_method_enum_);
+    if (body_pipe_)
+      body_pipe_->start();
   }
   catch (std::exception& e)
   {
+    if (pipe_fd_)
+      reinterpret_cast< PipeFd* >(pipe_fd_)->unsetResponse();
+    delete body_pipe_;
     deleteMetaVariables();
     throw;
   }
 }
 
+/*
+ * No process of its own, the script runs on the FastCGI server `upstream`.
+ * The body (if any) is sent from the upload file.
+ */
+CgiResponse::CgiResponse(int client_fd,
+                         bool close,
+                         const FastCgiAddress& upstream,
+                         const CgiVars& cgi_vars)
+    : Response(client_fd, 200, close),
+      pipe_fd_(NULL),
+      body_pipe_(NULL),
+      fastcgi_(NULL),
+      fastcgi_id_(0),
+      pool_(NULL),
+      pool_worker_(-1),
+      headers_created_(false),
+      status_found_(false),
+      meta_variables_(NULL),
+      cgi_vars_(cgi_vars),
+      last_chunk_sent_(false),
+      gzip_allowed_(false),
+      gzip_(NULL)
+{
+  startFastCgi(upstream);
+}
+
+/*
+ * The script runs on a worker of `pool`, which gets released again once the
+ * request is over
+ */
+CgiResponse::CgiResponse(int client_fd,
+                         bool close,
+                         CgiPool& pool,
+                         const CgiVars& cgi_vars)
+    : Response(client_fd, 200, close),
+      pipe_fd_(NULL),
+      body_pipe_(NULL),
+      fastcgi_(NULL),
+      fastcgi_id_(0),
+      pool_(NULL),
+      pool_worker_(-1),
+      headers_created_(false),
+      status_found_(false),
+      meta_variables_(NULL),
+      cgi_vars_(cgi_vars),
+      last_chunk_sent_(false),
+      gzip_allowed_(false),
+      gzip_(NULL)
+{
+  const FastCgiAddress& worker = pool.acquire(pool_worker_);
+  pool_ = &pool;
+
+  try
+  {
+    startFastCgi(worker);
+  }
+  catch (std::exception& e)
+  {
+    releaseWorker(true);
+    throw;
+  }
+}
+
 CgiResponse::~CgiResponse()
 {
+  delete gzip_;
   deleteMetaVariables();
   if (pipe_fd_)
   {
     PipeFd* converted = reinterpret_cast< PipeFd* >(pipe_fd_);
     converted->unsetResponse();
   }
+  if (body_pipe_)
+    body_pipe_->unsetResponse();
+  if (fastcgi_)
+    fastcgi_->abortRequest(fastcgi_id_);
+  releaseWorker(fastcgi_ == NULL);
+}
+
+void CgiResponse::startFastCgi(const FastCgiAddress& upstream)
+{
+  std::string input_file;
+  if (cgi_vars_.request_method_enum_ == POST)
+    input_file = cgi_vars_.input_file;
+
+  FastCgiConnection* connection = FastCgiConnection::acquire(upstream);
+  fastcgi_id_ =
+      connection->beginRequest(this, createMetaVariables(), input_file);
+  fastcgi_ = connection;
+}
+
+/*
+ * A worker whose request didn't finish (timeout, client gone) is most likely
+ * still busy with it, it gets stopped like a CGI process would be killed
+ */
+void CgiResponse::releaseWorker(bool finished)
+{
+  if (!pool_)
+    return;
+  pool_->release(pool_worker_, finished);
+  pool_ = NULL;
 }
 
 void CgiResponse::deleteMetaVariables(void)
 {
+  if (!meta_variables_)
+    return;
   for (size_t i = 0; meta_variables_[i] != NULL; ++i)
   {
     delete[] meta_variables_[i];
@@ -62,29 +178,96 @@ void CgiResponse::deleteMetaVariables(void)
   delete[] meta_variables_;
 }
 
+/*
+ * Output of the CGI: collected in `header_buffer_` until the header block is
+ * complete, everything after that is queued as chunks for the client.
+ */
+void CgiResponse::appendOutput(const char* data, size_t length)
+{
+  if (headers_created_)
+    queueBody(data, length);
+  else
+    header_buffer_.append(data, length);
+}
+
+bool CgiResponse::outputFull(void) const
+{
+  return header_buffer_.size() + pendingBytes() > CGI_OUTPUT_HIGH_WATERMARK;
+}
+
+void CgiResponse::queueBody(const char* data, size_t length)
+{
+  if (!gzip_)
+    return output_.pushChunk(data, length);
+
+  std::string compressed;
+  gzip_->write(data, length, compressed);
+  output_.pushChunk(compressed.data(), compressed.size());
+}
+
+void CgiResponse::allowGzip(void)
+{
+  gzip_allowed_ = true;
+}
+
+/*
+ * The output gets compressed while it's streamed, so a Content-Length from
+ * the CGI is only used to leave short responses alone
+ */
+void CgiResponse::setupCompression(void)
+{
+  const GzipSettings& gzip = Configuration::getInstance().getGzipSettings();
+  mHeader::iterator type = headers_.find("content-type");
+  if (type == headers_.end() || response_code_ != 200 ||
+      headers_.find("content-encoding") != headers_.end())
+    return;
+  std::string mime = Utils::trimString(
+      type->second.substr(0, type->second.find(';')));
+  std::for_each(mime.begin(), mime.end(), Utils::toLower);
+  if (!gzip.compresses(mime))
+    return;
+
+  if (headers_.find("vary") == headers_.end())
+    headers_["vary"] = "Accept-Encoding";
+  else
+    headers_["vary"] += ", Accept-Encoding";
+  if (!gzip_allowed_)
+    return;
+  mHeader::iterator length = headers_.find("content-length");
+  if (length != headers_.end() &&
+      std::strtoul(length->second.c_str(), NULL, 10) < gzip.min_length)
+    return;
+
+  headers_["content-encoding"] = "gzip";
+  gzip_ = new Utils::GzipEncoder();
+}
+
 void CgiResponse::processBuffer(void)
 {
-  size_t pos = full_response_.find('\n');
+  size_t start = 0;
+  size_t pos = header_buffer_.find('\n');
   while (pos != std::string::npos)
   {
     size_t realpos = pos;
-    if (realpos > 0 && full_response_[realpos - 1] == '\r')
+    if (realpos > start && header_buffer_[realpos - 1] == '\r')
     {
       --realpos;
     }
-    std::string line(full_response_, 0, realpos);
-    if (full_response_.size() > pos + 1)
-    {
-      full_response_ = std::string(full_response_, pos + 1);
-    }
-    else
-    {
-      full_response_.clear();
-    }
+    std::string line(header_buffer_, start, realpos - start);
+    start = pos + 1;
     addHeaderLine(line);
     if (headers_created_)
       break;
-    pos = full_response_.find('\n');
+    pos = header_buffer_.find('\n', start);
+  }
+  header_buffer_.erase(0, start);
+  if (!headers_created_ && header_buffer_.size() > CGI_OUTPUT_HIGH_WATERMARK)
+    throw RequestError(500, "Header block from CGI too large");
+
+  if (headers_created_)
+  {
+    queueBody(header_buffer_.data(), header_buffer_.size());
+    header_buffer_.clear();
   }
 }
 
@@ -92,26 +275,20 @@ void CgiResponse::addHeaderLine(const std::string& line)
 {
   if (line.empty())
   {
-    std::string rest(full_response_);
-    full_response_ = createGenericResponseLines();
+    setupCompression();
+    std::string header_block = createGenericResponseLines();
     for (mHeader::iterator it = headers_.begin(); it != headers_.end(); ++it)
     {
       if (it->first != "content-length" && it->first != "transfer-encoding")
-        full_response_ += it->first + ": " + it->second + "\r\n";
+        header_block += it->first + ": " + it->second + "\r\n";
     }
-    full_response_ += "Transfer-Encoding: chunked\r\n";
+    header_block += "Transfer-Encoding: chunked\r\n";
     std::vector< std::string >::iterator it;
     for (it = cookies_.begin(); it != cookies_.end(); ++it)
-      full_response_ += "Set-Cookie: " + *it + "\r\n";
-    full_response_ += "\r\n";
+      header_block += "Set-Cookie: " + *it + "\r\n";
+    header_block += "\r\n";
 
-    if (!rest.empty())
-    {
-      std::ostringstream ss;
-      ss << std::hex << rest.length() << "\r\n";
-
-      full_response_ += ss.str() + rest + "\r\n";
-    }
+    output_.take(header_block);
     headers_created_ = true;
     return;
   }
@@ -158,37 +335,45 @@ void CgiResponse::sendResponse(void)
     processBuffer();
     if (!headers_created_)
     {
-      if (!pipe_fd_)
+      if (!backendRunning())
         throw ExitExc();
       return;  // Don't send anything back until we have at least the headers
     }
   }
 
-  if (full_response_.empty())
+  // Once the CGI is done, the last chunk goes out together with the rest of
+  // the body instead of as a small write of its own that has to wait for the
+  // client's (delayed) ACK
+  if (!backendRunning() && !last_chunk_sent_)
   {
-    if (pipe_fd_)
-      return;
-
-    if (last_chunk_sent_)
+    if (gzip_)
     {
-      complete_ = true;
-      return;
+      std::string compressed;
+      gzip_->finish(compressed);
+      output_.pushChunk(compressed.data(), compressed.size());
     }
-
-    full_response_ += "0\r\n\r\n";
+    output_.pushLastChunk();
     last_chunk_sent_ = true;
   }
-  size_t amount =
-      std::min(static_cast< size_t >(CHUNK_SIZE), full_response_.length());
-  ssize_t ret = send(client_fd_, full_response_.c_str(), amount, 0);
-  if (ret == -1)
-    throw ConErr("Peer closed connection");
-  else if (ret == 0)
-    throw ConErr("Send returned 0?!");
-  full_response_ = full_response_.substr(ret);
+
+  if (pendingBytes() == 0 && backendRunning())
+    return;
+  if (flushBuffer() && last_chunk_sent_)
+    complete_ = true;
+  else if (pipe_fd_ && pendingBytes() <= CGI_OUTPUT_LOW_WATERMARK)
+    reinterpret_cast< PipeFd* >(pipe_fd_)->resumeReading();
 }
 
-char** CgiResponse::implementMetaVariables()
+/*
+ * The output of a CGI is streamed, so it's never handed over as a whole.
+ */
+bool CgiResponse::takeOutput(OutputQueue& queue)
+{
+  (void)queue;
+  return false;
+}
+
+std::vector< std::string > CgiResponse::createMetaVariables() const
 {
   std::vector< std::string > meta_vars;
   meta_vars.push_back("GATEWAY_INTERFACE=CGI/1.1");
@@ -216,10 +401,15 @@ char** CgiResponse::implementMetaVariables()
   meta_vars.push_back("REMOTE_ADDR=" + cgi_vars_.remote_addr);
   meta_vars.push_back("DOCUMENT_ROOT=" + cgi_vars_.document_root);
 
-  std::map< std::string, std::string >::iterator it;
+  std::map< std::string, std::string >::const_iterator it;
   for (it = cgi_vars_.headers.begin(); it != cgi_vars_.headers.end(); ++it)
     meta_vars.push_back(it->first + "=" + it->second);
+  return meta_vars;
+}
 
+char** CgiResponse::implementMetaVariables()
+{
+  std::vector< std::string > meta_vars = createMetaVariables();
   char** envp = new char*[meta_vars.size() + 1]();
   try
   {
@@ -247,6 +437,73 @@ void CgiResponse::unsetPipeFd(void)
   pipe_fd_ = NULL;
 }
 
+void CgiResponse::unsetFastCgi(bool finished)
+{
+  fastcgi_ = NULL;
+  releaseWorker(finished);
+}
+
+/*
+ * Hands the next part of the request body to the process. Once it stopped
+ * reading its stdin the rest is dropped.
+ */
+void CgiResponse::writeBody(const std::string& body, bool last)
+{
+  if (body_pipe_)
+    body_pipe_->write(body, last);
+}
+
+void CgiResponse::unsetBodyPipe(void)
+{
+  body_pipe_ = NULL;
+}
+
+bool CgiResponse::backendRunning(void) const
+{
+  return pipe_fd_ || fastcgi_;
+}
+
+/*
+ * The client connection stops polling for writing while it waits for output
+ * of the CGI (see Request::sendResponse, Connection::pollWhileStreaming),
+ * this makes it poll for writing again.
+ *
+ * Returns false if that failed.
+ */
+bool CgiResponse::resumeSending(void)
+{
+  EpollData& ed = getEpollData();
+  EpollFd* connection = ed.fds.find(client_fd_);
+  if (!connection)
+    return true;
+
+  epoll_event* event = connection->getEvent();
+  if (event->events & EPOLLOUT)
+    return true;
+  event->events |= EPOLLOUT | EPOLLRDHUP;
+  return epoll_ctl(ed.fd, EPOLL_CTL_MOD, client_fd_, event) != -1;
+}
+
+/*
+ * The client connection stops reading while the body can't be written to the
+ * process as fast as it comes in (see BodyPipe)
+ */
+void CgiResponse::pauseReading(void)
+{
+  EpollFd* connection = getEpollData().fds.find(client_fd_);
+  if (connection)
+    static_cast< Connection* >(connection)->pauseReading();
+}
+
+/*
+ * Returns false if that failed.
+ */
+bool CgiResponse::resumeReading(void)
+{
+  EpollFd* connection = getEpollData().fds.find(client_fd_);
+  return !connection || static_cast< Connection* >(connection)->resumeReading();
+}
+
 bool CgiResponse::getHeadersCreated() const
 {
   return headers_created_;
@@ -254,7 +511,7 @@ bool CgiResponse::getHeadersCreated() const
 
 bool CgiResponse::isCgiAndEmpty() const
 {
-  return full_response_.empty() && pipe_fd_;
+  return pendingBytes() == 0 && backendRunning();
 }
 
 bool CgiResponse::headersSent() const
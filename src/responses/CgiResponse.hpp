@@ -1,9 +1,28 @@
 #pragma once
 
+#include <vector>
+#include "../Configs/Configs.hpp"
 #include "../epoll/EpollFd.hpp"
 #include "../requests/Request.hpp"
 #include "../responses/Response.hpp"
+#include "../utils/Gzip.hpp"
 
+// Output of a CGI process buffered for a slow client: the pipe isn't read
+// anymore above the high mark, only once the client took it below the low one
+#define CGI_OUTPUT_HIGH_WATERMARK (256 * 1024)
+#define CGI_OUTPUT_LOW_WATERMARK (64 * 1024)
+
+class BodyPipe;
+class CgiPool;
+class FastCgiConnection;
+
+/*
+ * Response of a CGI script, run either as a process of its own (PipeFd) or
+ * by a FastCGI server (FastCgiConnection), which can also be a worker of a
+ * CgiPool. Both feed the output in through appendOutput() and unset
+ * themselves once the script is done. A process can also get the request
+ * body through a BodyPipe while it's still being received.
+ */
 class CgiResponse : public Response
 {
  public:
@@ -11,29 +30,60 @@ class CgiResponse : public Response
               bool close,
               const std::string& cgi_path,
               const CgiVars& cgi_vars);
+  CgiResponse(int client_fd,
+              bool close,
+              const FastCgiAddress& upstream,
+              const CgiVars& cgi_vars);
+  CgiResponse(int client_fd,
+              bool close,
+              CgiPool& pool,
+              const CgiVars& cgi_vars);
   ~CgiResponse();
 
   void sendResponse(void);
+  bool takeOutput(OutputQueue& queue);
+  void appendOutput(const char* data, size_t length);
+  bool outputFull(void) const;
+  void allowGzip(void);
   void unsetPipeFd(void);
+  void unsetFastCgi(bool finished);
+  void writeBody(const std::string& body, bool last);
+  void unsetBodyPipe(void);
+  bool resumeSending(void);
+  void pauseReading(void);
+  bool resumeReading(void);
   bool getHeadersCreated(void) const;
   bool isCgiAndEmpty(void) const;
   bool headersSent(void) const;
 
  private:
   EpollFd* pipe_fd_;
+  BodyPipe* body_pipe_;  // Set while the body is streamed to the process
+  FastCgiConnection* fastcgi_;
+  u_int16_t fastcgi_id_;
+  CgiPool* pool_;  // Set while a pool worker runs the script
+  pid_t pool_worker_;
   bool headers_created_;
+  std::string header_buffer_;
   mHeader headers_;
   bool status_found_;
   char** meta_variables_;
   CgiVars cgi_vars_;
-  const std::string& cgi_path_;
   bool last_chunk_sent_;
   std::vector< std::string > cookies_;
   int connection_fd_;
+  bool gzip_allowed_;  // The client accepts gzip
+  Utils::GzipEncoder* gzip_;
   CgiResponse(const CgiResponse& other);
   CgiResponse& operator=(const CgiResponse& other);
+  std::vector< std::string > createMetaVariables() const;
   char** implementMetaVariables();
+  bool backendRunning(void) const;
+  void startFastCgi(const FastCgiAddress& upstream);
+  void releaseWorker(bool finished);
   void processBuffer(void);
   void addHeaderLine(const std::string& line);
+  void setupCompression(void);
+  void queueBody(const char* data, size_t length);
   void deleteMetaVariables(void);
 };
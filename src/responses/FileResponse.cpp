@@ -1,18 +1,26 @@
 #include "FileResponse.hpp"
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include "../Configs/Configs.hpp"
+#include "../cache/FileCache.hpp"
 #include "../epoll/Connection.hpp"
 #include "../exceptions/ConError.hpp"
 #include "../exceptions/RequestError.hpp"
 #include "../requests/PathValidation/FileTypes.hpp"
 #include "../requests/PathValidation/PathInfos.hpp"
 #include "../requests/PathValidation/PathValidation.hpp"
+#include "../utils/Gzip.hpp"
+#include "../utils/Utils.hpp"
 
 /*
  * https://developer.mozilla.org/en-US/docs/Web/HTTP/Guides/MIME_types/Common_types
@@ -117,53 +125,452 @@ const MMimeTypes FileResponse::mime_types_ = createMimeTypesMap();
 FileResponse::FileResponse(int client_fd,
                            const std::string& filename,
                            int response_code,
-                           bool close)
+                           bool close,
+                           const std::string& encoding)
     : Response(client_fd, response_code, close),
+      file_(NULL),
+      cached_(NULL),
       headers_created_(false),
-      rd_buf_(new char[CHUNK_SIZE]),
-      eof_(false)
+      offset_(0),
+      remaining_(0),
+      file_size_(0),
+      next_part_(0),
+      mtime_(0),
+      not_modified_(false),
+      eof_(false),
+      use_sendfile_(Configuration::getInstance().getSendfile()),
+      encoding_(encoding),
+      vary_(false),
+      compressed_(false)
 {
-  try
-  {
-    openFile(filename);
+  // Precompressed siblings are sent with the type of the original file
+  if (encoding_.empty())
     content_type_ = detectContentType(filename);
+  else
+    content_type_ = detectContentType(filename.substr(0, filename.rfind('.')));
+  if (!loadFromCache(filename))
+    openFile(filename);
+}
+
+/*
+ * Serves small files from the file cache. On a miss the file gets read
+ * completely and put into the cache, on a hit the disk isn't touched at all.
+ *
+ * Returns false if the file has to be sent from disk instead.
+ */
+bool FileResponse::loadFromCache(const std::string& filename)
+{
+  FileCache& cache = getFileCache();
+  if (!cache.enabled())
+    return false;
+
+  PathInfos infos = getOpenFileCache().getFileType(filename);
+  cached_ = cache.find(filename, infos);
+  if (cached_)
+  {
+    setValidators(infos);
+    file_size_ = infos.size;
+    remaining_ = 0;
+    return true;
   }
-  catch (std::exception& e)
+  if (!infos.exists || infos.types != REGULAR_FILE ||
+      !cache.accepts(infos.size))
+    return false;
+
+  openFile(filename);
+  if (!cache.accepts(remaining_))
+    return true;  // Changed in the meantime, just send it from disk
+
+  std::string body;
+  if (!readBody(body))
+    return true;
+
+  cached_ = Utils::SharedBuffer::create();
+  cached_->data() = createContentHeaders() + body;
+  cache.insert(filename, file_->infos, cached_);
+  getOpenFileCache().release(file_);
+  file_ = NULL;
+  remaining_ = 0;
+  return true;
+}
+
+/*
+ * Reads the complete file, either out of the cached response or from disk
+ */
+bool FileResponse::readBody(std::string& body) const
+{
+  if (cached_)
   {
-    delete[] rd_buf_;
-    throw;
+    const std::string& data = cached_->data();
+    body.assign(data, data.size() - file_size_, file_size_);
+    return true;
   }
+
+  body.assign(file_size_, '\0');
+  off_t offset = 0;
+  while (offset < file_size_)
+  {
+    ssize_t ret = pread(file_fd_, &body[offset], file_size_ - offset, offset);
+    if (ret <= 0)
+      return false;
+    offset += ret;
+  }
+  return true;
 }
 
-void FileResponse::createHeaders()
+/*
+ * Switches to the gzip compressed body if the content type is configured for
+ * compression and the client accepts it. The result is kept in the gzip
+ * cache, so a file only gets compressed again once it changed.
+ *
+ * Compressing blocks the event loop (about 20 ms for GZIP_MAX_FILE), so files
+ * whose result couldn't be cached are sent as they are instead of being
+ * compressed again on every request.
+ */
+void FileResponse::compress(const std::string& filename, bool accepted)
 {
-  std::ostringstream response;
+  const GzipSettings& gzip = Configuration::getInstance().getGzipSettings();
+  if (!gzip.compresses(content_type_) || !encoding_.empty())
+    return;
+  vary_ = true;
+  FileCache& cache = getGzipCache();
+  if (!accepted || response_code_ != 200 ||
+      file_size_ < static_cast< off_t >(gzip.min_length) ||
+      !cache.accepts(file_size_))
+    return;
 
-  response << createGenericResponseLines() << "Content-Length: " << remaining_
-           << "\r\nContent-Type: " << content_type_ << "\r\n\r\n";
+  PathInfos infos = getOpenFileCache().getFileType(filename);
+  Utils::SharedBuffer* compressed = cache.find(filename, infos);
+  std::string body;
+  if (!compressed)
+  {
+    if (!readBody(body))
+      return;
+    body = Utils::gzip(body);
+    if (static_cast< off_t >(body.size()) >= file_size_)
+      return;
+  }
 
-  full_response_ = response.str();
-  headers_created_ = true;
+  encoding_ = "gzip";
+  compressed_ = true;
+  setValidators(infos);
+  if (compressed)
+  {
+    const std::string& data = compressed->data();
+    file_size_ = data.size() - (data.find("\r\n\r\n") + 4);
+  }
+  else
+  {
+    remaining_ = body.size();
+    compressed = Utils::SharedBuffer::create();
+    compressed->data() = createContentHeaders() + body;
+    if (cache.accepts(body.size()))
+      cache.insert(filename, infos, compressed);
+    file_size_ = body.size();
+  }
+
+  if (cached_)
+    cached_->release();
+  if (file_)
+    getOpenFileCache().release(file_);
+  file_ = NULL;
+  cached_ = compressed;
+  offset_ = 0;
+  remaining_ = 0;
 }
 
-void FileResponse::openFile(const std::string& filename)
+std::string FileResponse::createContentHeaders() const
+{
+  std::ostringstream headers;
+
+  if (response_code_ == 416)
+  {
+    headers << "Content-Range: bytes */" << file_size_
+            << "\r\nContent-Length: 0\r\n\r\n";
+    return headers.str();
+  }
+
+  headers << "Accept-Ranges: bytes\r\n";
+  if (!boundary_.empty())
+    headers << "Content-Length: " << multipartLength() << "\r\n";
+  else
+  {
+    headers << "Content-Length: " << remaining_ << "\r\n";
+    if (!ranges_.empty())
+      headers << "Content-Range: " << createContentRange(ranges_[0]) << "\r\n";
+  }
+  headers << validator_headers_ << "\r\n";
+  return headers.str();
+}
+
+/*
+ * Not part of the cached header block, the same file can be sent with a
+ * different type or encoding depending on how it was requested
+ */
+std::string FileResponse::createTypeHeaders() const
+{
+  std::string headers;
+
+  if (!boundary_.empty())
+    headers = "Content-Type: multipart/byteranges; boundary=" + boundary_ +
+              "\r\n";
+  else if (response_code_ != 304 && response_code_ != 416)
+  {
+    headers = "Content-Type: " + content_type_ + "\r\n";
+    if (!encoding_.empty())
+      headers += "Content-Encoding: " + encoding_ + "\r\n";
+  }
+  if (vary_)
+    headers += "Vary: Accept-Encoding\r\n";
+  return headers;
+}
+
+void FileResponse::setVary(void)
+{
+  vary_ = true;
+}
+
+/*
+ * The ETag is built from inode, size and mtime, so it changes whenever the
+ * file gets replaced or modified (as long as the mtime changes).
+ */
+void FileResponse::setValidators(const PathInfos& infos)
+{
+  std::ostringstream headers;
+
+  etag_ = createETag(infos);
+  if (compressed_)
+    etag_.insert(etag_.size() - 1, "-gzip");
+  mtime_ = infos.mtime;
+  headers << "ETag: " << etag_ << "\r\n";
+  std::string last_modified = Utils::formatHttpDate(mtime_);
+  if (!last_modified.empty())
+    headers << "Last-Modified: " << last_modified << "\r\n";
+  validator_headers_ = headers.str();
+}
+
+std::string FileResponse::createETag(const PathInfos& infos)
+{
+  std::ostringstream etag;
+
+  etag << std::hex << '"' << static_cast< unsigned long >(infos.inode) << '-'
+       << static_cast< unsigned long >(infos.size) << '-'
+       << static_cast< unsigned long >(infos.mtime) << '"';
+  return etag.str();
+}
+
+/*
+ * Conditional GET (RFC 9110, 13.1.1/13.1.3): If-None-Match takes precedence,
+ * If-Modified-Since is only looked at without it. If the client's copy is
+ * still up to date the response turns into a body-less 304. NULL means the
+ * header wasn't sent.
+ */
+void FileResponse::evaluateConditions(const std::string* if_none_match,
+                                      const std::string* if_modified_since)
+{
+  if (response_code_ != 200)
+    return;
+
+  if (if_none_match)
+  {
+    if (!etagMatches(*if_none_match))
+      return;
+  }
+  else if (if_modified_since)
+  {
+    std::time_t since = Utils::parseHttpDate(*if_modified_since);
+    if (since == static_cast< std::time_t >(-1) || mtime_ > since)
+      return;
+  }
+  else
+    return;
+
+  response_code_ = 304;
+  response_title_ = "Not Modified";
+  not_modified_ = true;
+  remaining_ = 0;
+}
+
+/*
+ * Weak comparison against every entry of the If-None-Match list
+ */
+bool FileResponse::etagMatches(const std::string& list) const
+{
+  std::string own = etag_;
+  std::istringstream stream(list);
+  std::string entry;
+
+  while (std::getline(stream, entry, ','))
+  {
+    entry = Utils::trimString(entry);
+    if (entry == "*")
+      return true;
+    if (entry.compare(0, 2, "W/") == 0)
+      entry.erase(0, 2);
+    if (entry == own)
+      return true;
+  }
+  return false;
+}
+
+/*
+ * Turns the response into a 206 for the satisfiable parts of `ranges`, or
+ * into a 416 if there are none. A single range is sent like a whole file
+ * (sendfile() just starts at its offset), several ones as a
+ * multipart/byteranges body, see nextPart().
+ */
+void FileResponse::applyRanges(const VByteRanges& ranges,
+                               const std::string* if_range)
 {
-  PathInfos infos = getFileType(filename);
-  if (infos.exists && infos.types == REGULAR_FILE && !infos.readable)
-    throw RequestError(403, "File is not readable");
-  else if (!infos.exists || infos.types != REGULAR_FILE)
-    throw RequestError(404, "File doesn't exist or isn't a regular file");
+  if (response_code_ != 200)
+    return;
+  if (if_range && !ifRangeMatches(*if_range))
+    return;
+
+  for (VByteRanges::const_iterator it = ranges.begin(); it != ranges.end();
+       ++it)
+  {
+    ByteRange range = *it;
+    if (range.first == -1)
+    {
+      if (range.last == 0 || file_size_ == 0)
+        continue;
+      range.first = std::max(static_cast< off_t >(0), file_size_ - range.last);
+      range.last = file_size_ - 1;
+    }
+    else
+    {
+      if (range.first >= file_size_)
+        continue;
+      if (range.last == -1 || range.last >= file_size_)
+        range.last = file_size_ - 1;
+    }
+    ranges_.push_back(range);
+  }
 
-  file_fd_ = open(filename.c_str(), O_RDONLY | O_NOFOLLOW);
-  if (file_fd_ == -1)
+  if (ranges_.empty())
   {
-    if (errno == ELOOP)
-      throw RequestError(403, "Requested file is a symlink");
-    else if (errno == ENFILE || errno == EMFILE)
-      throw RequestError(503, "Server ran out of fds");
-    throw RequestError(500, "Open failed for unknown reason");
+    response_code_ = 416;
+    response_title_ = "Range Not Satisfiable";
+    remaining_ = 0;
+    return;
   }
-  remaining_ = infos.size;
+
+  response_code_ = 206;
+  response_title_ = "Partial Content";
+  if (ranges_.size() == 1)
+  {
+    offset_ = ranges_[0].first;
+    remaining_ = ranges_[0].last - ranges_[0].first + 1;
+    return;
+  }
+
+  static unsigned long boundaries = 0;
+  std::ostringstream boundary;
+  boundary << std::hex << std::setfill('0') << std::setw(8)
+           << static_cast< unsigned long >(std::time(NULL)) << std::setw(8)
+           << ++boundaries;
+  boundary_ = boundary.str();
+  remaining_ = 0;
+}
+
+/*
+ * Our ETags are strong, so If-Range needs an exact match. A date only
+ * matches if it's exactly the Last-Modified time.
+ */
+bool FileResponse::ifRangeMatches(const std::string& value) const
+{
+  if (!value.empty() && value[0] == '"')
+    return value == etag_;
+  std::time_t date = Utils::parseHttpDate(value);
+  return date != static_cast< std::time_t >(-1) && date == mtime_;
+}
+
+std::string FileResponse::createContentRange(const ByteRange& range) const
+{
+  std::ostringstream content_range;
+
+  content_range << "bytes " << range.first << '-' << range.last << '/'
+                << file_size_;
+  return content_range.str();
+}
+
+std::string FileResponse::createPartHeader(const ByteRange& range) const
+{
+  return "\r\n--" + boundary_ + "\r\nContent-Type: " + content_type_ +
+         "\r\nContent-Range: " + createContentRange(range) + "\r\n\r\n";
+}
+
+off_t FileResponse::multipartLength(void) const
+{
+  off_t length = boundary_.size() + 8;  // "\r\n--" boundary "--\r\n"
+
+  for (VByteRanges::const_iterator it = ranges_.begin(); it != ranges_.end();
+       ++it)
+    length += createPartHeader(*it).size() + it->last - it->first + 1;
+  return length;
+}
+
+/*
+ * Queues the header of the next part of a multipart/byteranges body and
+ * points offset_ and remaining_ to its range, after the last part the
+ * closing delimiter. Returns false once there is nothing left to queue.
+ */
+bool FileResponse::nextPart(void)
+{
+  if (boundary_.empty() || next_part_ > ranges_.size())
+    return false;
+  if (next_part_ == ranges_.size())
+  {
+    output_.push("\r\n--" + boundary_ + "--\r\n");
+    ++next_part_;
+    return true;
+  }
+
+  const ByteRange& range = ranges_[next_part_++];
+  output_.push(createPartHeader(range));
+  offset_ = range.first;
+  remaining_ = range.last - range.first + 1;
+  return true;
+}
+
+void FileResponse::createHeaders()
+{
+  headers_created_ = true;
+  if (not_modified_)
+  {
+    output_.push(createGenericResponseLines() + createTypeHeaders() +
+                 validator_headers_ + "\r\n");
+    use_sendfile_ = false;
+    return;
+  }
+  if (cached_ && response_code_ == 200)
+  {
+    output_.push(createGenericResponseLines() + createTypeHeaders());
+    output_.pushShared(cached_);
+    use_sendfile_ = false;
+    return;
+  }
+  if (cached_)
+    use_sendfile_ = false;  // Ranges get copied out of the cached body
+
+  output_.push(createGenericResponseLines() + createTypeHeaders() +
+               createContentHeaders());
+  nextPart();
+
+  // Small files are read into the queue as well, so headers and body leave in
+  // a single writev() instead of a send() followed by a sendfile()
+  if (remaining_ <= CHUNK_SIZE)
+    use_sendfile_ = false;
+}
+
+void FileResponse::openFile(const std::string& filename)
+{
+  file_ = getOpenFileCache().open(filename);
+  file_fd_ = file_->fd;
+  remaining_ = file_->infos.size;
+  file_size_ = file_->infos.size;
+  setValidators(file_->infos);
 }
 
 std::string FileResponse::detectContentType(const std::string& filename) const
@@ -181,8 +588,10 @@ std::string FileResponse::detectContentType(const std::string& filename) const
 
 FileResponse::~FileResponse()
 {
-  delete[] rd_buf_;
-  close(file_fd_);
+  if (cached_)
+    cached_->release();
+  if (file_)
+    getOpenFileCache().release(file_);
 }
 
 void FileResponse::sendResponse(void)
@@ -190,21 +599,99 @@ void FileResponse::sendResponse(void)
   if (!headers_created_)
     createHeaders();
 
-  if (full_response_.size() < CHUNK_SIZE && remaining_ > 0 && !eof_)
-  {
-    size_t amount = std::min(static_cast< size_t >(CHUNK_SIZE),
-                             static_cast< size_t >(remaining_));
-    ssize_t ret = read(file_fd_, rd_buf_, amount);
-    if (ret == -1)
-      throw ConErr("Read failed");
+  if (use_sendfile_)
+    return sendFileContents();
+
+  if (remaining_ == 0 && !eof_)
+    nextPart();
+  if (pendingBytes() < CHUNK_SIZE && remaining_ > 0 && !eof_)
+    readFileChunk();
+
+  bool done = (remaining_ == 0 &&
+               (boundary_.empty() || next_part_ > ranges_.size())) ||
+              eof_;
+  if (flushBuffer() && done)
+    complete_ = true;
+}
 
-    eof_ = (ret == 0 || ret == remaining_);
-    if (ret == 0)
-      close_connection_ = true;
+/*
+ * Small files are read completely and handed to the pipelining queue of the
+ * connection, bigger ones are sent on their own.
+ */
+bool FileResponse::takeOutput(OutputQueue& queue)
+{
+  if (!headers_created_)
+    createHeaders();
 
-    remaining_ -= ret;
-    full_response_.append(rd_buf_, ret);
+  if (use_sendfile_ || remaining_ > CHUNK_SIZE || !boundary_.empty())
+    return false;
+  if (remaining_ > 0)
+    readFileChunk();
+  if (remaining_ > 0 && !eof_)
+    return false;
+  return Response::takeOutput(queue);
+}
+
+void FileResponse::readFileChunk(void)
+{
+  size_t amount = std::min(static_cast< size_t >(CHUNK_SIZE),
+                           static_cast< size_t >(remaining_));
+  if (cached_)
+  {
+    const std::string& data = cached_->data();
+    output_.push(data.data() + (data.size() - file_size_) + offset_, amount);
+    offset_ += amount;
+    remaining_ -= amount;
+    return;
   }
 
-  Response::sendResponse();
+  std::string body(amount, '\0');
+  ssize_t ret = pread(file_fd_, &body[0], amount, offset_);
+  if (ret == -1)
+    throw ConErr("Read failed");
+
+  eof_ = (ret == 0);
+  if (ret == 0)
+    close_connection_ = true;
+
+  offset_ += ret;
+  remaining_ -= ret;
+  body.resize(ret);
+  output_.take(body);
+}
+
+/*
+ * Zero-copy path: the headers are still sent from `output_`, afterwards
+ * the kernel copies the body straight from `file_fd_` into the socket until
+ * either the whole file is sent or the socket buffer is full (EAGAIN).
+ */
+void FileResponse::sendFileContents(void)
+{
+  while (flushBuffer())
+  {
+    while (remaining_ > 0)
+    {
+      ssize_t ret = sendfile(client_fd_, file_fd_, &offset_,
+                             static_cast< size_t >(remaining_));
+      if (ret == -1)
+      {
+        if (errno == EAGAIN)
+          return;
+        throw ConErr("Sendfile failed");
+      }
+      else if (ret == 0)
+      {
+        // File got truncated after Content-Length was sent, can't recover
+        close_connection_ = true;
+        complete_ = true;
+        return;
+      }
+      remaining_ -= ret;
+    }
+    if (!nextPart())
+    {
+      complete_ = true;
+      return;
+    }
+  }
 }
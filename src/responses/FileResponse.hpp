@@ -1,8 +1,12 @@
 #pragma once
 
 #include <sys/types.h>
+#include <ctime>
 #include <map>
 #include <string>
+#include "../cache/OpenFileCache.hpp"
+#include "../requests/ByteRanges.hpp"
+#include "../utils/SharedBuffer.hpp"
 #include "Response.hpp"
 
 typedef std::map< std::string, std::string > MMimeTypes;
@@ -13,24 +17,60 @@ class FileResponse : public Response
   FileResponse(int client_fd,
                const std::string& filename,
                int response_code = 200,
-               bool close = false);
+               bool close = false,
+               const std::string& encoding = "");
   ~FileResponse();
 
   void sendResponse(void);
+  bool takeOutput(OutputQueue& queue);
+  void evaluateConditions(const std::string* if_none_match,
+                          const std::string* if_modified_since);
+  void applyRanges(const VByteRanges& ranges,
+                   const std::string* if_range);
+  void setVary(void);
+  void compress(const std::string& filename, bool accepted);
   static const MMimeTypes mime_types_;
 
  private:
+  CachedFile* file_;
+  Utils::SharedBuffer* cached_;  // Content headers and body from the cache
   int file_fd_;
   bool headers_created_;
-  off_t remaining_;
-  char* rd_buf_;
+  off_t offset_;  // The fd is shared through the cache, never use its offset
+  off_t remaining_;  // Of the whole file or the current range
+  off_t file_size_;
+  VByteRanges ranges_;  // Satisfiable ranges of a 206 response
+  size_t next_part_;    // Next part of a multipart/byteranges body
+  std::string boundary_;
+  std::string etag_;
+  std::time_t mtime_;
+  std::string validator_headers_;  // ETag and Last-Modified
+  bool not_modified_;
   bool eof_;
+  bool use_sendfile_;
   std::string content_type_;
+  std::string encoding_;  // Content-Encoding of precompressed siblings
+  bool vary_;
+  bool compressed_;  // Compressed on the fly, not a precompressed sibling
 
   FileResponse(const FileResponse& other);
   FileResponse& operator=(const FileResponse& other);
 
   void openFile(const std::string& filename);
+  bool loadFromCache(const std::string& filename);
+  bool readBody(std::string& body) const;
+  std::string createContentHeaders() const;
+  std::string createTypeHeaders() const;
+  void setValidators(const PathInfos& infos);
+  static std::string createETag(const PathInfos& infos);
+  bool etagMatches(const std::string& list) const;
+  bool ifRangeMatches(const std::string& value) const;
+  std::string createContentRange(const ByteRange& range) const;
+  std::string createPartHeader(const ByteRange& range) const;
+  off_t multipartLength(void) const;
+  bool nextPart(void);
   void createHeaders();
+  void readFileChunk();
+  void sendFileContents();
   std::string detectContentType(const std::string& filename) const;
 };
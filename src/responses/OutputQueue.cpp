@@ -0,0 +1,208 @@
+#include "OutputQueue.hpp"
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <cerrno>
+#include <cstdio>
+#include "../exceptions/ConError.hpp"
+
+#define OUTPUT_IOV_BATCH 64
+
+OutputQueue::OutputQueue() : front_offset_(0), size_(0) {}
+
+OutputQueue::~OutputQueue()
+{
+  clear();
+}
+
+OutputQueue::Segment& OutputQueue::pushSegment(void)
+{
+  segments_.push_back(Segment());
+  Segment& segment = segments_.back();
+  segment.literal = NULL;
+  segment.shared = NULL;
+  segment.length = 0;
+  return segment;
+}
+
+void OutputQueue::popSegment(void)
+{
+  if (segments_.front().shared)
+    segments_.front().shared->release();
+  segments_.pop_front();
+  front_offset_ = 0;
+}
+
+void OutputQueue::push(const std::string& data)
+{
+  push(data.data(), data.size());
+}
+
+void OutputQueue::push(const char* data, size_t length)
+{
+  if (length == 0)
+    return;
+  Segment& segment = pushSegment();
+  segment.data.assign(data, length);
+  segment.length = length;
+  size_ += length;
+}
+
+/*
+ * Takes over the contents of `data` without copying them, `data` is left
+ * empty afterwards.
+ */
+void OutputQueue::take(std::string& data)
+{
+  if (data.empty())
+    return;
+  Segment& segment = pushSegment();
+  segment.data.swap(data);
+  segment.length = segment.data.size();
+  size_ += segment.length;
+}
+
+/*
+ * Only stores the pointer, so `literal` has to outlive the queue.
+ */
+void OutputQueue::pushLiteral(const char* literal)
+{
+  if (*literal == '\0')
+    return;
+  Segment& segment = pushSegment();
+  segment.literal = literal;
+  segment.length = std::char_traits< char >::length(literal);
+  size_ += segment.length;
+}
+
+/*
+ * Keeps a reference to `buffer` until it's sent, the buffer must not be
+ * modified anymore.
+ */
+void OutputQueue::pushShared(Utils::SharedBuffer* buffer)
+{
+  if (buffer->data().empty())
+    return;
+  buffer->retain();
+  Segment& segment = pushSegment();
+  segment.shared = buffer;
+  segment.length = buffer->data().size();
+  size_ += segment.length;
+}
+
+/*
+ * Queues `data` as one chunk of the chunked transfer coding: size line, data
+ * and the trailing CRLF end up in separate segments.
+ */
+void OutputQueue::pushChunk(const char* data, size_t length)
+{
+  if (length == 0)
+    return;
+
+  char size_line[24];
+  int ret = std::sprintf(size_line, "%lx\r\n",
+                         static_cast< unsigned long >(length));
+  push(size_line, static_cast< size_t >(ret));
+  push(data, length);
+  pushLiteral("\r\n");
+}
+
+void OutputQueue::pushLastChunk(void)
+{
+  pushLiteral("0\r\n\r\n");
+}
+
+/*
+ * Moves all pending segments of `other` to the end of this queue, owned
+ * segments are swapped over instead of copied.
+ */
+void OutputQueue::splice(OutputQueue& other)
+{
+  while (!other.segments_.empty())
+  {
+    Segment& front = other.segments_.front();
+    if (front.literal)
+      pushLiteral(front.literal + other.front_offset_);
+    else if (front.shared && other.front_offset_ == 0)
+      pushShared(front.shared);
+    else if (front.shared)
+      push(front.shared->data().data() + other.front_offset_,
+           front.length - other.front_offset_);
+    else if (other.front_offset_ > 0)
+      push(front.data.data() + other.front_offset_,
+           front.length - other.front_offset_);
+    else
+      take(front.data);
+    other.popSegment();
+  }
+  other.size_ = 0;
+}
+
+/*
+ * Hands up to OUTPUT_IOV_BATCH segments to writev() at once and drops
+ * everything the socket accepted from the queue.
+ *
+ * Returns true if there is nothing left to send, false if the socket buffer
+ * is full.
+ */
+bool OutputQueue::flush(int fd)
+{
+  if (segments_.empty())
+    return true;
+
+  struct iovec iov[OUTPUT_IOV_BATCH];
+  int count = 0;
+  for (std::deque< Segment >::iterator it = segments_.begin();
+       it != segments_.end() && count < OUTPUT_IOV_BATCH; ++it, ++count)
+  {
+    const char* base = it->data.data();
+    if (it->literal)
+      base = it->literal;
+    else if (it->shared)
+      base = it->shared->data().data();
+    size_t offset = (count == 0) ? front_offset_ : 0;
+    iov[count].iov_base = const_cast< char* >(base + offset);
+    iov[count].iov_len = it->length - offset;
+  }
+
+  ssize_t ret = writev(fd, iov, count);
+  if (ret == -1)
+  {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return false;
+    throw ConErr("Peer closed connection");
+  }
+  else if (ret == 0)
+    throw ConErr("Send returned 0?!");
+
+  size_t sent = static_cast< size_t >(ret);
+  size_ -= sent;
+  while (sent > 0)
+  {
+    size_t left = segments_.front().length - front_offset_;
+    if (sent < left)
+    {
+      front_offset_ += sent;
+      break;
+    }
+    sent -= left;
+    popSegment();
+  }
+  return segments_.empty();
+}
+
+void OutputQueue::clear(void)
+{
+  while (!segments_.empty())
+    popSegment();
+  size_ = 0;
+}
+
+size_t OutputQueue::size(void) const
+{
+  return size_;
+}
+
+bool OutputQueue::empty(void) const
+{
+  return segments_.empty();
+}
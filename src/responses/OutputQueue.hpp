@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include "../utils/SharedBuffer.hpp"
+
+/*
+ * Queue of output segments (header block, body parts, chunk framing) that get
+ * sent with a single writev() call instead of being concatenated into one
+ * string first. Segments are either owned strings, pointers to string
+ * literals (enough for the fixed parts of the chunked encoding) or references
+ * to shared buffers, e.g. file contents from the file cache.
+ */
+class OutputQueue
+{
+ public:
+  OutputQueue();
+  ~OutputQueue();
+
+  void push(const std::string& data);
+  void push(const char* data, size_t length);
+  void take(std::string& data);
+  void pushLiteral(const char* literal);
+  void pushShared(Utils::SharedBuffer* buffer);
+  void pushChunk(const char* data, size_t length);
+  void pushLastChunk(void);
+  void splice(OutputQueue& other);
+  bool flush(int fd);
+  void clear(void);
+
+  size_t size(void) const;
+  bool empty(void) const;
+
+ private:
+  struct Segment
+  {
+    std::string data;
+    const char* literal;
+    Utils::SharedBuffer* shared;
+    size_t length;
+  };
+
+  std::deque< Segment > segments_;
+  size_t front_offset_;  // Already sent part of the first segment
+  size_t size_;          // Pending bytes over all segments
+
+  Segment& pushSegment(void);
+  void popSegment(void);
+
+  OutputQueue(const OutputQueue& other);
+  OutputQueue& operator=(const OutputQueue& other);
+};
@@ -11,7 +11,7 @@ RedirectResponse::RedirectResponse(int client_fd,
   response << createGenericResponseLines() << "Location: " << redirect_location
            << "\r\nContent-Length: 0\r\n\r\n";
 
-  full_response_ = response.str();
+  output_.push(response.str());
 }
 
 RedirectResponse::~RedirectResponse() {}
@@ -3,11 +3,10 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
-#include <ctime>
 #include <ostream>
 #include <sstream>
-#include "../epoll/Connection.hpp"
-#include "../exceptions/ConError.hpp"
+#include <vector>
+#include "../utils/Utils.hpp"
 
 Response::Response(int client_fd, int response_code, bool close_connection)
     : client_fd_(client_fd),
@@ -15,92 +14,112 @@ Response::Response(int client_fd, int response_code, bool close_connection)
       close_connection_(close_connection),
       complete_(false)
 {
+  response_title_ = getDefaultTitle(response_code);
+  // After these the rest of the request might still be unread
   switch (response_code)
   {
-    case 200:
-      response_title_ = "OK";
+    case 400:
+    case 408:
+    case 409:
+    case 411:
+    case 413:
+    case 414:
+    case 500:
+    case 501:
+    case 502:
+    case 503:
+    case 504:
+    case 505:
+    case 507:
+      close_connection_ = true;
       break;
-    case 201:
-      response_title_ = "Created";
+    default:
       break;
+  }
+}
+
+const char* Response::getDefaultTitle(u_int16_t code)
+{
+  switch (code)
+  {
+    case 200:
+      return "OK";
+    case 201:
+      return "Created";
     case 204:
-      response_title_ = "No Content";
-      break;
+      return "No Content";
+    case 206:
+      return "Partial Content";
     case 301:
-      response_title_ = "Moved Permanently";
-      break;
+      return "Moved Permanently";
     case 302:
-      response_title_ = "Found";
-      break;
+      return "Found";
     case 303:
-      response_title_ = "See Other";
-      break;
+      return "See Other";
+    case 304:
+      return "Not Modified";
     case 307:
-      response_title_ = "Temporary Redirect";
-      break;
+      return "Temporary Redirect";
     case 308:
-      response_title_ = "Permanent Redirect";
-      break;
+      return "Permanent Redirect";
     case 400:
-      response_title_ = "Bad Request";
-      close_connection_ = true;
-      break;
+      return "Bad Request";
     case 403:
-      response_title_ = "Forbidden";
-      break;
+      return "Forbidden";
     case 404:
-      response_title_ = "Not Found";
-      break;
+      return "Not Found";
     case 405:
-      response_title_ = "Method Not Allowed";
-      break;
+      return "Method Not Allowed";
     case 408:
-      response_title_ = "Request Timeout";
-      close_connection_ = true;
-      break;
+      return "Request Timeout";
     case 409:
-      response_title_ = "Conflict";
-      close_connection_ = true;
-      break;
+      return "Conflict";
     case 411:
-      response_title_ = "Length Required";
-      close_connection_ = true;
-      break;
+      return "Length Required";
     case 413:
-      response_title_ = "Payload Too Large";
-      close_connection_ = true;
-      break;
+      return "Payload Too Large";
     case 414:
-      response_title_ = "URI Too Long";
-      close_connection_ = true;
-      break;
+      return "URI Too Long";
+    case 416:
+      return "Range Not Satisfiable";
     case 500:
-      response_title_ = "Internal Server Error";
-      close_connection_ = true;
-      break;
+      return "Internal Server Error";
     case 501:
-      response_title_ = "Not Implemented";
-      close_connection_ = true;
-      break;
+      return "Not Implemented";
+    case 502:
+      return "Bad Gateway";
     case 503:
-      response_title_ = "Service unavailable";
-      close_connection_ = true;
-      break;
+      return "Service unavailable";
     case 504:
-      response_title_ = "Gateway Timeout";
-      close_connection_ = true;
-      break;
+      return "Gateway Timeout";
     case 505:
-      response_title_ = "HTTP Version Not Supported";
-      close_connection_ = true;
-      break;
+      return "HTTP Version Not Supported";
     case 507:
-      response_title_ = "Insufficient Storage";
-      close_connection_ = true;
-      break;
+      return "Insufficient Storage";
     default:
-      response_title_ = "Not implemented";
+      return "Not implemented";
+  }
+}
+
+/*
+ * "HTTP/1.1 <code> <title>\r\n" with the default title, rendered once for
+ * every code
+ */
+const std::string& Response::getStatusLine(u_int16_t code)
+{
+  static std::vector< std::string > lines;
+
+  if (lines.empty())
+  {
+    lines.resize(600);
+    for (u_int16_t i = 100; i < lines.size(); ++i)
+    {
+      std::ostringstream line;
+      line << "HTTP/1.1 " << i << " " << getDefaultTitle(i) << "\r\n";
+      lines[i] = line.str();
+    }
   }
+  return lines[code < lines.size() ? code : 500];
 }
 
 Response::~Response() {}
@@ -115,35 +134,30 @@ bool Response::isComplete() const
   return complete_;
 }
 
+/*
+ * Only the status line of a non-default title (e.g. from a CGI) still gets
+ * formatted here, everything else is copied from pre-rendered strings
+ */
 std::string Response::createGenericResponseLines(void) const
 {
-  std::ostringstream stream;
+  std::string lines;
+  lines.reserve(128);
 
-  stream << "HTTP/1.1 " << response_code_ << " " << response_title_ << "\r\n";
-  addDateHeader(stream);
-  stream << "Connection: ";
+  if (response_code_ >= 100 && response_code_ < 600 &&
+      response_title_ == getDefaultTitle(response_code_))
+    lines = getStatusLine(response_code_);
+  else
+  {
+    std::ostringstream stream;
+    stream << "HTTP/1.1 " << response_code_ << " " << response_title_ << "\r\n";
+    lines = stream.str();
+  }
+  lines += Utils::getDateLine();
   if (close_connection_)
-    stream << "close\r\n";
+    lines += "Connection: close\r\n";
   else
-    stream << "keep-alive\r\n";
-  return stream.str();
-}
-
-void Response::addDateHeader(std::ostringstream& stream) const
-{
-  std::time_t current = std::time(NULL);
-
-  if (current == static_cast< std::time_t >(-1))
-    return;
-  std::tm* gmt = std::gmtime(&current);
-
-  if (!gmt)
-    return;
-
-  char buffer[30];
-  std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", gmt);
-
-  stream << "Date: " << buffer << "\r\n";
+    lines += "Connection: keep-alive\r\n";
+  return lines;
 }
 
 bool Response::getClosing() const
@@ -158,22 +172,36 @@ u_int16_t Response::getResponseCode() const
 
 void Response::sendResponse()
 {
-  const char* buf;
-  size_t amount;
-  ssize_t ret;
+  if (flushBuffer())
+    complete_ = true;
+}
 
-  buf = full_response_.c_str();
-  amount = std::min(static_cast< size_t >(CHUNK_SIZE), full_response_.length());
+/*
+ * Used for pipelining: if the whole response is already buffered, it gets
+ * moved to `queue` (the output of the connection) and counts as sent.
+ *
+ * Returns false if the response has to be sent with sendResponse() instead.
+ */
+bool Response::takeOutput(OutputQueue& queue)
+{
+  queue.splice(output_);
+  complete_ = true;
+  return true;
+}
 
-  ret = send(client_fd_, buf, amount, 0);
-  if (ret == -1)
-    throw ConErr("Peer closed connection");
-  else if (ret == 0)
-    throw ConErr("Send returned 0?!");
+/*
+ * Sends as much of `output_` as the socket accepts in one writev() call.
+ *
+ * Returns true if there is nothing left to send.
+ */
+bool Response::flushBuffer()
+{
+  return output_.flush(client_fd_);
+}
 
-  full_response_ = full_response_.substr(ret);
-  if (full_response_.empty())
-    complete_ = true;
+size_t Response::pendingBytes() const
+{
+  return output_.size();
 }
 
 bool Response::isCgiAndEmpty() const
@@ -3,6 +3,7 @@
 #include <sys/types.h>
 #include <sstream>
 #include <string>
+#include "OutputQueue.hpp"
 
 class Response
 {
@@ -12,6 +13,7 @@ class Response
 
   void setCloseConnectionHeader(void);
   virtual void sendResponse(void);
+  virtual bool takeOutput(OutputQueue& queue);
   bool isComplete(void) const;
   bool getClosing() const;
   u_int16_t getResponseCode() const;
@@ -19,7 +21,7 @@ class Response
   int getClientFd(void) const;
 
  protected:
-  std::string full_response_;
+  OutputQueue output_;
   std::string response_title_;
   int client_fd_;
   u_int16_t response_code_;
@@ -27,10 +29,13 @@ class Response
   bool complete_;
 
   std::string createGenericResponseLines(void) const;
+  bool flushBuffer(void);
+  size_t pendingBytes(void) const;
 
  private:
   Response(const Response& other);
   Response& operator=(const Response& other);
 
-  void addDateHeader(std::ostringstream& stream) const;
+  static const char* getDefaultTitle(u_int16_t code);
+  static const std::string& getStatusLine(u_int16_t code);
 };
@@ -17,9 +17,9 @@ StaticResponse::StaticResponse(int client_fd, int response_code, bool close)
   response << createGenericResponseLines()
            << "Content-Length: " << content.length()
            << "\r\nContent-Type: text/html; charset=utf-8\r\n\r\n";
-  response << content;
 
-  full_response_ = response.str();
+  output_.push(response.str());
+  output_.take(content);
 }
 
 StaticResponse::StaticResponse(
@@ -42,8 +42,8 @@ StaticResponse::StaticResponse(
     response << it->first << ": " << it->second << "\r\n";
   }
   response << "\r\n";
-  response << content;
-  full_response_ = response.str();
+  output_.push(response.str());
+  output_.push(content);
 }
 
 StaticResponse::~StaticResponse() {}
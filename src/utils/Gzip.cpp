@@ -0,0 +1,299 @@
+#include "Gzip.hpp"
+#include <algorithm>
+
+#define GZIP_WINDOW 32768
+#define GZIP_HASH_BITS 14
+#define GZIP_MAX_CHAIN 16
+#define GZIP_MIN_MATCH 3
+#define GZIP_MAX_MATCH 258
+
+static const unsigned int LENGTH_BASE[] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const int LENGTH_EXTRA[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                   1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                   4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const unsigned int DISTANCE_BASE[] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+static const int DISTANCE_EXTRA[] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                     4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                     9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static u_int32_t updateCrc(u_int32_t crc, const char* data, size_t length)
+{
+  static u_int32_t table[256];
+  static bool initialized = false;
+
+  if (!initialized)
+  {
+    for (u_int32_t i = 0; i < 256; ++i)
+    {
+      u_int32_t c = i;
+      for (int k = 0; k < 8; ++k)
+        c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      table[i] = c;
+    }
+    initialized = true;
+  }
+
+  for (size_t i = 0; i < length; ++i)
+    crc = table[(crc ^ static_cast< unsigned char >(data[i])) & 0xff] ^
+          (crc >> 8);
+  return crc;
+}
+
+static size_t hash(const std::string& window, size_t pos)
+{
+  size_t value = (static_cast< unsigned char >(window[pos]) << 10) ^
+                 (static_cast< unsigned char >(window[pos + 1]) << 5) ^
+                 static_cast< unsigned char >(window[pos + 2]);
+  return value & ((1 << GZIP_HASH_BITS) - 1);
+}
+
+/*
+ * Huffman codes are stored starting with their most significant bit, while
+ * everything else is written starting with the least significant one
+ */
+static u_int32_t reverseBits(u_int32_t code, int length)
+{
+  u_int32_t reversed = 0;
+
+  for (int i = 0; i < length; ++i)
+    reversed |= ((code >> i) & 1) << (length - 1 - i);
+  return reversed;
+}
+
+/*
+ * The fixed literal/length codes (RFC 1951, 3.2.6), already bit reversed
+ */
+struct FixedCodes
+{
+  FixedCodes()
+  {
+    for (u_int32_t value = 0; value < 288; ++value)
+    {
+      if (value < 144)
+        set(value, 0x30 + value, 8);
+      else if (value < 256)
+        set(value, 0x190 + value - 144, 9);
+      else if (value < 280)
+        set(value, value - 256, 7);
+      else
+        set(value, 0xc0 + value - 280, 8);
+    }
+  }
+
+  void set(u_int32_t value, u_int32_t code, int length)
+  {
+    literals[value] = reverseBits(code, length);
+    literal_lengths[value] = length;
+  }
+
+  u_int32_t literals[288];
+  int literal_lengths[288];
+};
+
+namespace Utils
+{
+  GzipEncoder::GzipEncoder()
+      : window_start_(0),
+        encoded_(0),
+        bits_(0),
+        bit_count_(0),
+        crc_(0xffffffff),
+        size_(0),
+        started_(false)
+  {}
+
+  /*
+   * The last GZIP_MAX_MATCH bytes are held back, so matches can continue into
+   * the data of the next call
+   */
+  void GzipEncoder::write(const char* data, size_t length, std::string& out)
+  {
+    start(out);
+    crc_ = updateCrc(crc_, data, length);
+    size_ += length;
+    window_.append(data, length);
+    if (window_.size() - encoded_ > GZIP_MAX_MATCH)
+      deflate(window_.size() - GZIP_MAX_MATCH, out);
+  }
+
+  /*
+   * Encodes the rest of the input, ends the block and appends the CRC32 and
+   * size trailer
+   */
+  void GzipEncoder::finish(std::string& out)
+  {
+    start(out);
+    deflate(window_.size(), out);
+    writeLiteral(256, out);
+    if (bit_count_ > 0)
+      writeBits(0, 8 - bit_count_, out);
+    for (int i = 0; i < 32; i += 8)
+      out += static_cast< char >(((crc_ ^ 0xffffffff) >> i) & 0xff);
+    for (int i = 0; i < 32; i += 8)
+      out += static_cast< char >((size_ >> i) & 0xff);
+  }
+
+  /*
+   * Encodes the input up to `limit`, matches may extend past it
+   */
+  void GzipEncoder::deflate(size_t limit, std::string& out)
+  {
+    size_t pos = encoded_;
+    size_t end = window_.size();
+
+    while (pos < limit)
+    {
+      size_t distance = 0;
+      size_t match = 0;
+      if (end - pos >= GZIP_MIN_MATCH)
+        match = findMatch(pos, end, distance);
+      if (match >= GZIP_MIN_MATCH)
+      {
+        writeMatch(match, distance, out);
+        for (size_t i = pos; i < pos + match && i + 2 < end; ++i)
+          insertHash(i);
+        pos += match;
+      }
+      else
+      {
+        writeLiteral(static_cast< unsigned char >(window_[pos]), out);
+        if (pos + 2 < end)
+          insertHash(pos);
+        ++pos;
+      }
+    }
+    encoded_ = pos;
+
+    // Only trimmed once the history is twice the window, so erase() runs
+    // rarely
+    if (encoded_ > 2 * GZIP_WINDOW)
+    {
+      size_t drop = encoded_ - GZIP_WINDOW;
+      window_.erase(0, drop);
+      window_start_ += drop;
+      encoded_ -= drop;
+    }
+  }
+
+  /*
+   * gzip header without name and mtime, followed by the header of the one
+   * and only (final, fixed Huffman) block
+   */
+  void GzipEncoder::start(std::string& out)
+  {
+    static const char header[] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, 3};
+
+    if (started_)
+      return;
+    started_ = true;
+    head_.assign(1 << GZIP_HASH_BITS, 0);
+    prev_.assign(GZIP_WINDOW, 0);
+    out.append(header, sizeof(header));
+    writeBits(1, 1, out);  // BFINAL
+    writeBits(1, 2, out);  // BTYPE 01
+  }
+
+  /*
+   * Positions are stored as stream position + 1 (0 = empty) and may wrap
+   * around, only their differences are used.
+   */
+  void GzipEncoder::insertHash(size_t pos)
+  {
+    u_int32_t position = static_cast< u_int32_t >(window_start_ + pos + 1);
+    size_t value = hash(window_, pos);
+
+    prev_[(position - 1) & (GZIP_WINDOW - 1)] = head_[value];
+    head_[value] = position;
+  }
+
+  /*
+   * Returns the length of the longest match for the data at `pos` within the
+   * window (0 if there is none) and sets `distance` accordingly
+   */
+  size_t GzipEncoder::findMatch(size_t pos, size_t end, size_t& distance) const
+  {
+    u_int32_t current = static_cast< u_int32_t >(window_start_ + pos + 1);
+    u_int32_t candidate = head_[hash(window_, pos)];
+    size_t max = std::min(static_cast< size_t >(GZIP_MAX_MATCH), end - pos);
+    size_t best = 0;
+
+    for (int chain = 0; candidate != 0 && chain < GZIP_MAX_CHAIN; ++chain)
+    {
+      u_int32_t offset = current - candidate;
+      if (offset == 0 || offset > GZIP_WINDOW || offset > pos)
+        break;
+
+      size_t start = pos - offset;
+      if (window_[start + best] == window_[pos + best])
+      {
+        size_t length = 0;
+        while (length < max &&
+               window_[start + length] == window_[pos + length])
+          ++length;
+        if (length > best)
+        {
+          best = length;
+          distance = offset;
+          if (best == max)
+            break;
+        }
+      }
+
+      // An older entry of the ring buffer got overwritten, the chain ends
+      u_int32_t next = prev_[(candidate - 1) & (GZIP_WINDOW - 1)];
+      if (next == 0 || current - next <= offset)
+        break;
+      candidate = next;
+    }
+    return best;
+  }
+
+  void GzipEncoder::writeBits(u_int32_t value, int count, std::string& out)
+  {
+    bits_ |= value << bit_count_;
+    bit_count_ += count;
+    while (bit_count_ >= 8)
+    {
+      out += static_cast< char >(bits_ & 0xff);
+      bits_ >>= 8;
+      bit_count_ -= 8;
+    }
+  }
+
+  void GzipEncoder::writeLiteral(unsigned int value, std::string& out)
+  {
+    static const FixedCodes codes;
+
+    writeBits(codes.literals[value], codes.literal_lengths[value], out);
+  }
+
+  void GzipEncoder::writeMatch(size_t length, size_t distance, std::string& out)
+  {
+    int code = 28;
+    while (LENGTH_BASE[code] > length)
+      --code;
+    writeLiteral(257 + code, out);
+    writeBits(length - LENGTH_BASE[code], LENGTH_EXTRA[code], out);
+
+    code = 29;
+    while (DISTANCE_BASE[code] > distance)
+      --code;
+    writeBits(reverseBits(code, 5), 5, out);
+    writeBits(distance - DISTANCE_BASE[code], DISTANCE_EXTRA[code], out);
+  }
+
+  std::string gzip(const std::string& data)
+  {
+    GzipEncoder encoder;
+    std::string out;
+
+    encoder.write(data.data(), data.size(), out);
+    encoder.finish(out);
+    return out;
+  }
+}  // namespace Utils
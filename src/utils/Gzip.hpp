@@ -0,0 +1,51 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Utils
+{
+  /*
+   * Minimal streaming gzip (RFC 1952) encoder, since we can't link zlib.
+   *
+   * The whole stream is a single DEFLATE block with the fixed Huffman codes
+   * (RFC 1951, 3.2.6), matches are searched with hash chains over the last
+   * 32K of input. That doesn't compress as well as zlib's dynamic trees, but
+   * still shrinks HTML/CSS/JS to about a third at a fraction of the CPU.
+   *
+   * write() can be called any number of times and only returns complete
+   * bytes, the remaining bits stay buffered until the next call or finish().
+   */
+  class GzipEncoder
+  {
+   public:
+    GzipEncoder();
+
+    void write(const char* data, size_t length, std::string& out);
+    void finish(std::string& out);
+
+   private:
+    std::string window_;  // At least 32K of history, then the pending input
+    u_int64_t window_start_;         // Stream position of window_[0]
+    size_t encoded_;                 // Start of the pending input
+    std::vector< u_int32_t > head_;  // Last position+1 per hash value
+    std::vector< u_int32_t > prev_;  // Previous position+1 with same hash
+    u_int32_t bits_;
+    int bit_count_;
+    u_int32_t crc_;
+    u_int32_t size_;
+    bool started_;
+
+    void start(std::string& out);
+    void deflate(size_t limit, std::string& out);
+    void insertHash(size_t pos);
+    size_t findMatch(size_t pos, size_t end, size_t& distance) const;
+    void writeBits(u_int32_t value, int count, std::string& out);
+    void writeLiteral(unsigned int value, std::string& out);
+    void writeMatch(size_t length, size_t distance, std::string& out);
+  };
+
+  std::string gzip(const std::string& data);
+}  // namespace Utils
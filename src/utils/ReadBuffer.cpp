@@ -0,0 +1,76 @@
+#include "ReadBuffer.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace Utils
+{
+  const size_t ReadBuffer::npos;
+
+  ReadBuffer::ReadBuffer() : read_pos_(0) {}
+
+  ReadBuffer::~ReadBuffer() {}
+
+  void ReadBuffer::append(const char* data, size_t length)
+  {
+    compact();
+    data_.append(data, length);
+  }
+
+  void ReadBuffer::consume(size_t amount)
+  {
+    read_pos_ = std::min(read_pos_ + amount, data_.size());
+  }
+
+  void ReadBuffer::clear()
+  {
+    data_.clear();
+    read_pos_ = 0;
+  }
+
+  size_t ReadBuffer::size() const
+  {
+    return data_.size() - read_pos_;
+  }
+
+  bool ReadBuffer::empty() const
+  {
+    return read_pos_ == data_.size();
+  }
+
+  const char* ReadBuffer::data() const
+  {
+    return data_.data() + read_pos_;
+  }
+
+  /*
+   * Returns the position relative to the read cursor, like every other
+   * position used in here
+   */
+  size_t ReadBuffer::find(char c) const
+  {
+    const void* found = std::memchr(data(), c, size());
+
+    if (!found)
+      return npos;
+    return static_cast< const char* >(found) - data();
+  }
+
+  std::string ReadBuffer::substr(size_t pos, size_t length) const
+  {
+    return data_.substr(read_pos_ + pos, length);
+  }
+
+  char ReadBuffer::operator[](size_t pos) const
+  {
+    return data_[read_pos_ + pos];
+  }
+
+  void ReadBuffer::compact()
+  {
+    if (read_pos_ > 0 && read_pos_ >= data_.size() / 2)
+    {
+      data_.erase(0, read_pos_);
+      read_pos_ = 0;
+    }
+  }
+}  // namespace Utils
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Utils
+{
+  /*
+   * Input buffer with a read cursor. Consuming data only advances the cursor,
+   * the already consumed bytes at the front get dropped in one go once they
+   * make up at least half of the buffer, so parsing line by line doesn't copy
+   * the remaining data over and over again.
+   *
+   * Pointers returned by data() stay valid until the next append(), even if
+   * the data got consumed in the meantime.
+   */
+  class ReadBuffer
+  {
+   public:
+    static const size_t npos = std::string::npos;
+
+    ReadBuffer();
+    ~ReadBuffer();
+
+    void append(const char* data, size_t length);
+    void consume(size_t amount);
+    void clear();
+
+    size_t size() const;
+    bool empty() const;
+    const char* data() const;
+    size_t find(char c) const;
+    std::string substr(size_t pos, size_t length) const;
+    char operator[](size_t pos) const;
+
+   private:
+    std::string data_;
+    size_t read_pos_;
+
+    void compact();
+
+    ReadBuffer(const ReadBuffer& other);
+    ReadBuffer& operator=(const ReadBuffer& other);
+  };
+}  // namespace Utils
@@ -0,0 +1,34 @@
+#include "SharedBuffer.hpp"
+
+namespace Utils
+{
+  SharedBuffer::SharedBuffer() : refs_(1) {}
+
+  SharedBuffer::~SharedBuffer() {}
+
+  SharedBuffer* SharedBuffer::create(void)
+  {
+    return new SharedBuffer();
+  }
+
+  void SharedBuffer::retain(void)
+  {
+    ++refs_;
+  }
+
+  void SharedBuffer::release(void)
+  {
+    if (--refs_ == 0)
+      delete this;
+  }
+
+  std::string& SharedBuffer::data(void)
+  {
+    return data_;
+  }
+
+  const std::string& SharedBuffer::data(void) const
+  {
+    return data_;
+  }
+}  // namespace Utils
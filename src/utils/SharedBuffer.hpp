@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Utils
+{
+  /*
+   * Reference counted, immutable once shared. Used for data that is owned by
+   * a cache but might still be queued for sending after the cache dropped it.
+   * Created with a reference count of 1, deletes itself when the last
+   * reference gets released.
+   */
+  class SharedBuffer
+  {
+   public:
+    static SharedBuffer* create(void);
+
+    void retain(void);
+    void release(void);
+    std::string& data(void);
+    const std::string& data(void) const;
+
+   private:
+    std::string data_;
+    size_t refs_;
+
+    SharedBuffer();
+    ~SharedBuffer();
+    SharedBuffer(const SharedBuffer& other);
+    SharedBuffer& operator=(const SharedBuffer& other);
+  };
+}  // namespace Utils
@@ -0,0 +1,70 @@
+#include "Spawn.hpp"
+#include <cerrno>
+
+namespace Utils
+{
+  Spawn::Spawn() : error_(0)
+  {
+    error_ = posix_spawn_file_actions_init(&actions_);
+  }
+
+  Spawn::~Spawn()
+  {
+    posix_spawn_file_actions_destroy(&actions_);
+  }
+
+  void Spawn::chdir(const std::string& directory)
+  {
+    if (error_ == 0)
+      error_ =
+          posix_spawn_file_actions_addchdir_np(&actions_, directory.c_str());
+  }
+
+  void Spawn::open(int target, const std::string& path, int flags, mode_t mode)
+  {
+    if (error_ == 0)
+      error_ = posix_spawn_file_actions_addopen(&actions_, target,
+                                                path.c_str(), flags, mode);
+  }
+
+  void Spawn::dup2(int fd, int target)
+  {
+    if (error_ == 0)
+      error_ = posix_spawn_file_actions_adddup2(&actions_, fd, target);
+  }
+
+  /*
+   * Closing an fd that isn't open is no error
+   */
+  void Spawn::close(int fd)
+  {
+    if (error_ == 0)
+      error_ = posix_spawn_file_actions_addclose(&actions_, fd);
+  }
+
+  /*
+   * Returns the pid of the new process, or -1 with errno set if any of the
+   * actions or execve itself failed
+   */
+  pid_t Spawn::run(const std::string& path,
+                   char* const argv[],
+                   char* const envp[])
+  {
+    if (error_ == 0)
+      error_ = posix_spawn_file_actions_addclosefrom_np(&actions_, 3);
+    if (error_ != 0)
+    {
+      errno = error_;
+      return -1;
+    }
+
+    pid_t pid;
+    int ret = posix_spawn(&pid, path.c_str(), &actions_, NULL, argv, envp);
+    if (ret != 0)
+    {
+      errno = ret;
+      return -1;
+    }
+    return pid;
+  }
+}  // namespace Utils
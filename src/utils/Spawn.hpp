@@ -0,0 +1,38 @@
+#pragma once
+
+#include <spawn.h>
+#include <sys/types.h>
+#include <string>
+
+namespace Utils
+{
+  /*
+   * Starts a program with posix_spawn instead of fork + execve. glibc runs
+   * the child on the server's memory until execve (clone with CLONE_VM and
+   * CLONE_VFORK), so no page tables get copied and the cost doesn't grow
+   * with the size of the server (caches).
+   *
+   * Everything the child has to do before execve is recorded up front and
+   * done in that order. All fds from 3 on get closed, the child only keeps
+   * what it got as stdin, stdout and stderr.
+   */
+  class Spawn
+  {
+   public:
+    Spawn();
+    ~Spawn();
+
+    void chdir(const std::string& directory);
+    void open(int target, const std::string& path, int flags, mode_t mode);
+    void dup2(int fd, int target);
+    void close(int fd);
+    pid_t run(const std::string& path, char* const argv[], char* const envp[]);
+
+   private:
+    posix_spawn_file_actions_t actions_;
+    int error_;  // First error while recording the actions
+
+    Spawn(const Spawn& other);
+    Spawn& operator=(const Spawn& other);
+  };
+}  // namespace Utils
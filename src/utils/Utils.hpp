@@ -13,6 +13,7 @@ namespace Utils
   u_int8_t ipStrToUint8(const std::string& str);
   u_int16_t ipStrToUint16(const std::string& str);
   u_int64_t strToMaxBodySize(const std::string& str);
+  u_int64_t strToSize(const std::string& str, u_int64_t max);
   u_int16_t errStrToUint16(const std::string& str);
 
   // ── ◼︎ String utils ───────────────────────────────
@@ -26,6 +27,10 @@ namespace Utils
 
   // Time utils
   u_int64_t getCurrentTime();
+  std::string formatHttpDate(time_t time);
+  time_t parseHttpDate(const std::string& date);
+  void updateDateLine(void);
+  const std::string& getDateLine(void);
 
   // Fd Utils
   int addCloExecFlag(int fd);
@@ -61,6 +61,34 @@ namespace Utils
     return num_part * multiplier;
   }
 
+  /*
+   * Sizes in the nginx style: a number optionally followed by k, m or g
+   * (case insensitive)
+   */
+  u_int64_t strToSize(const std::string& str, u_int64_t max)
+  {
+    if (str.empty() || str[0] < '0' || str[0] > '9')
+      throw Fatal("Invalid size");
+    char* endptr = NULL;
+    errno = 0;
+    u_int64_t num_part = strtoul(str.c_str(), &endptr, 10);
+    if (errno == ERANGE)
+      throw Fatal("Invalid size");
+    u_int64_t multiplier = 1;
+    std::string unit_part(endptr);
+    if (unit_part == "k" || unit_part == "K")
+      multiplier = 1024;
+    else if (unit_part == "m" || unit_part == "M")
+      multiplier = 1024 * 1024;
+    else if (unit_part == "g" || unit_part == "G")
+      multiplier = 1024 * 1024 * 1024;
+    else if (!unit_part.empty())
+      throw Fatal("Invalid size unit. Allowed: k, K, m, M, g, G");
+    if (num_part > max / multiplier)
+      throw Fatal("Invalid size");
+    return num_part * multiplier;
+  }
+
   u_int16_t errStrToUint16(const std::string& token)
   {
     char* endptr;
@@ -1,10 +1,15 @@
 #include <stddef.h>
 #include <sys/types.h>
+#include <time.h>
 #include <ctime>
 #include <stdexcept>
+#include <string>
 
 namespace Utils
 {
+  static std::string date_line;
+  static std::time_t date_line_time = static_cast< std::time_t >(-1);
+
   /*
    * Returns the current time in seconds
    */
@@ -17,4 +22,66 @@ namespace Utils
 
     return (static_cast< u_int64_t >(time));
   }
+
+  /*
+   * Formats `time` as IMF-fixdate, e.g. `Sun, 06 Nov 1994 08:49:37 GMT`.
+   * Returns an empty string if the time can't be converted.
+   */
+  std::string formatHttpDate(std::time_t time)
+  {
+    std::tm* gmt = std::gmtime(&time);
+    if (!gmt)
+      return "";
+
+    char buffer[30];
+    std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", gmt);
+    return buffer;
+  }
+
+  /*
+   * Renders the cached `Date:` header line again if a new second started,
+   * called once per event loop iteration
+   */
+  void updateDateLine(void)
+  {
+    std::time_t now = std::time(NULL);
+    if (now == date_line_time || now == static_cast< std::time_t >(-1))
+      return;
+
+    std::string date = formatHttpDate(now);
+    if (date.empty())
+      return;
+    date_line = "Date: " + date + "\r\n";
+    date_line_time = now;
+  }
+
+  /*
+   * The `Date:` line (including CRLF) as of the last updateDateLine() call
+   */
+  const std::string& getDateLine(void)
+  {
+    if (date_line_time == static_cast< std::time_t >(-1))
+      updateDateLine();
+    return date_line;
+  }
+
+  /*
+   * Accepts all three date formats of RFC 9110 (IMF-fixdate, RFC 850 and
+   * asctime). Returns -1 for anything else.
+   */
+  std::time_t parseHttpDate(const std::string& date)
+  {
+    static const char* formats[] = {"%a, %d %b %Y %H:%M:%S GMT",
+                                     "%A, %d-%b-%y %H:%M:%S GMT",
+                                     "%a %b %e %H:%M:%S %Y", NULL};
+
+    for (size_t i = 0; formats[i] != NULL; ++i)
+    {
+      std::tm tm = std::tm();
+      const char* end = strptime(date.c_str(), formats[i], &tm);
+      if (end != NULL && *end == '\0')
+        return timegm(&tm);
+    }
+    return static_cast< std::time_t >(-1);
+  }
 }  // namespace Utils
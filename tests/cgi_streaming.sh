@@ -0,0 +1,95 @@
+#!/bin/bash
+
+# Needs a location with `cgi_request_buffering off` that runs .py scripts as
+# processes, with cgi_skript/echo.py in its root (/cgi/ in webserv.conf). The
+# memory test reads the RSS of the webserv processes on this machine.
+
+if [[ "$WEBSERV_PORT" == "" ]]; then
+  echo "Environment variable missing, set \$WEBSERV_PORT"
+  exit 1
+fi
+
+ECHO_URI="${ECHO_URI:-/cgi/echo.py}"
+TMPDIR=$(mktemp -d)
+trap 'rm -rf "$TMPDIR"' EXIT
+
+TOTAL_TESTS=0
+PASSED_TESTS=0
+FAILED_TESTS=0
+
+# The script writes the body back while it's still reading it, so the output
+# has to keep flowing while the body is streamed to it
+testecho() {
+  TOTAL_TESTS=$((TOTAL_TESTS + 1))
+  echo -n "Test echo of $1 bytes => "
+
+  head -c "$1" /dev/urandom >"$TMPDIR/body"
+  code=$(curl -s -m 20 -H "Expect:" -o "$TMPDIR/response" -w "%{http_code}" \
+    --data-binary @"$TMPDIR/body" "http://127.0.0.1:$WEBSERV_PORT$ECHO_URI")
+  if [[ "$code" != "200" ]]; then
+    echo "Expected 200, got $code"
+    FAILED_TESTS=$((FAILED_TESTS + 1))
+    return 1
+  fi
+  if ! cmp -s "$TMPDIR/body" "$TMPDIR/response"; then
+    echo "Response differs from the request body"
+    FAILED_TESTS=$((FAILED_TESTS + 1))
+    return 1
+  fi
+  PASSED_TESTS=$((PASSED_TESTS + 1))
+  echo "OK"
+}
+
+# Resident memory of all server processes in kB
+serverrss() {
+  local total=0
+  for pid in $(pgrep -x webserv); do
+    kb=$(awk '/^VmRSS/ {print $2}' "/proc/$pid/status" 2>/dev/null)
+    total=$((total + ${kb:-0}))
+  done
+  echo "$total"
+}
+
+# The server stops reading the output of the script above the high mark
+# (256 KiB) until the client took it, so its memory doesn't grow with the
+# size of the echoed body. Twice the mark leaves room for the pipe buffers.
+testmemory() {
+  TOTAL_TESTS=$((TOTAL_TESTS + 1))
+  echo -n "Test server memory while echoing $1 bytes => "
+
+  head -c "$1" /dev/urandom >"$TMPDIR/body"
+  before=$(serverrss)
+  peak=$before
+  curl -s -m 20 -H "Expect:" --limit-rate 10M -o "$TMPDIR/response" \
+    --data-binary @"$TMPDIR/body" "http://127.0.0.1:$WEBSERV_PORT$ECHO_URI" &
+  curl_pid=$!
+  while kill -0 "$curl_pid" 2>/dev/null; do
+    now=$(serverrss)
+    if ((now > peak)); then
+      peak=$now
+    fi
+    sleep 0.01
+  done
+  wait "$curl_pid"
+  if ! cmp -s "$TMPDIR/body" "$TMPDIR/response"; then
+    echo "Response differs from the request body"
+    FAILED_TESTS=$((FAILED_TESTS + 1))
+    return 1
+  fi
+  if ((before == 0 || peak - before > 512)); then
+    echo "Server memory grew by $((peak - before)) kB"
+    FAILED_TESTS=$((FAILED_TESTS + 1))
+    return 1
+  fi
+  PASSED_TESTS=$((PASSED_TESTS + 1))
+  echo "OK (+$((peak - before)) kB)"
+}
+
+testecho 5
+testecho 65536
+testecho 2000000
+testecho 20000000
+testmemory 20000000
+
+echo "============================================================"
+echo "Total Tests: $TOTAL_TESTS, Passed: $PASSED_TESTS, Failed: $FAILED_TESTS"